@@ -0,0 +1,315 @@
+#include "lr_parser.h"
+#include "grammar_loader.h"
+#include "synthetic_grammar.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+/*
+ * Times the phases of lalr_grammar::build() on synthetic grammars of growing size and writes
+ * the results as JSON, one record per grammar.
+ *
+ * Usage: construction-bench [options]
+ *   --family NAME      Only this family (repeatable): expression_tower, wide_alternation,
+ *                      nullable_chain, long_list. Default: all
+ *   --sizes N,N,...    Target production counts. Default: 10,30,100,300,1000,3000,10000
+ *   --repeat N         Builds per grammar; each phase reports its minimum and median. Default: 3
+ *   --budget SECONDS   Skip the larger sizes of a family once one build took longer. Default: 60
+ *   --output FILE      Write the JSON to FILE instead of stdout
+ *   --emit DIR         Also write each generated grammar to DIR/<family>_<size>.txt
+ *   --trace DIR        Also write the phases of the last build of each grammar in the Chrome
+ *                      trace format to DIR/<family>_<size>.trace.json
+ *
+ * Each record also carries the counters of lalr_grammar::stats from the last build.
+ */
+
+namespace {
+
+	using clock_type = std::chrono::steady_clock;
+
+	/*
+	 * Phases of lalr_grammar::build() as named in build_stats_t: the top-level ones in order, with
+	 * build_lr0_states, which initialize_lalr1_states runs and whose time it includes, next to it
+	 */
+	const char* const PHASES[] = { "comp_first_sets", "build_lr0_states", "initialize_lalr1_states", "set_lalr1_items_lookaheads", "build_action_table" };
+	constexpr size_t PHASE_COUNT = sizeof(PHASES) / sizeof(PHASES[0]);
+
+	struct options_t {
+		std::vector<bench::grammar_family_t> families;
+		std::vector<size_t> sizes = { 10, 30, 100, 300, 1000, 3000, 10000 };
+		size_t repeat = 3;
+		double budget_seconds = 60;
+		std::string output;
+		std::string emit_dir;
+		std::string trace_dir;
+	};
+
+	/* Result of building one grammar repeat times */
+	struct result_t {
+		const bench::synthetic_grammar_t* grammar = nullptr;
+		size_t target = 0;
+		std::string status = "ok";                    // "ok", "skipped" or the error of the build
+		size_t terminals = 0;
+		size_t non_terminals = 0;
+		size_t states = 0;
+		std::vector<double> phase_ms[PHASE_COUNT];    // Wall time of each phase, one entry per build
+		std::vector<double> total_ms;                 // Wall time of each whole build
+		parse::build_stats_t stats;                   // Statistics of the last build
+	};
+
+	double elapsed_ms(clock_type::time_point since)
+	{
+		return std::chrono::duration<double, std::milli>(clock_type::now() - since).count();
+	}
+
+	double median(std::vector<double> values)
+	{
+		if (values.empty())
+			return 0;
+		std::sort(values.begin(), values.end());
+		size_t mid = values.size() / 2;
+		return values.size() % 2 ? values[mid] : (values[mid - 1] + values[mid]) / 2;
+	}
+
+	double minimum(const std::vector<double>& values)
+	{
+		return values.empty() ? 0 : *std::min_element(values.begin(), values.end());
+	}
+
+	std::string json_string(const std::string& s)
+	{
+		std::string result = "\"";
+		for (char c : s) {
+			switch (c) {
+			case '"': result += "\\\""; break;
+			case '\\': result += "\\\\"; break;
+			case '\n': result += "\\n"; break;
+			case '\t': result += "\\t"; break;
+			default:
+				if (static_cast<unsigned char>(c) < 0x20) {
+					char escaped[8];
+					std::snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+					result += escaped;
+				}
+				else {
+					result += c;
+				}
+			}
+		}
+		return result + "\"";
+	}
+
+	std::string json_number(double value)
+	{
+		char buffer[32];
+		std::snprintf(buffer, sizeof(buffer), "%.3f", value);
+		return buffer;
+	}
+
+	/* Builds a grammar once and takes the phase times from its statistics */
+	void build_once(const bench::synthetic_grammar_t& grammar, result_t& result)
+	{
+		std::unique_ptr<parse::lalr_grammar> g = parse::build_grammar(parse::load_grammar(grammar.text));
+		result.terminals = g->terminals.size();
+		result.non_terminals = g->non_terminals.size();
+
+		g->collect_conflicts = true;
+		clock_type::time_point start = clock_type::now();
+		g->build();
+		result.total_ms.push_back(elapsed_ms(start));
+		if (!g->conflicts.empty())
+			throw std::runtime_error(g->conflicts.front().message);
+
+		for (size_t i = 0; i < PHASE_COUNT; i++)
+			result.phase_ms[i].push_back(g->stats.phase_ms(PHASES[i]));
+		result.states = g->lalr1_states.size();
+		result.stats = g->stats;
+	}
+
+	std::string to_json(const options_t& options, const std::vector<result_t>& results)
+	{
+		std::ostringstream out;
+		out << "{\n  \"benchmark\": \"construction\",\n  \"repeat\": " << options.repeat << ",\n  \"results\": [";
+
+		for (size_t r = 0; r < results.size(); r++) {
+			const result_t& result = results[r];
+			out << (r == 0 ? "\n" : ",\n") << "    {"
+				<< "\"family\": " << json_string(bench::family_name(result.grammar->family))
+				<< ", \"target\": " << result.target
+				<< ", \"parameter\": " << result.grammar->parameter
+				<< ", \"productions\": " << result.grammar->productions
+				<< ", \"status\": " << json_string(result.status);
+
+			if (!result.total_ms.empty()) {
+				out << ", \"terminals\": " << result.terminals
+					<< ", \"non_terminals\": " << result.non_terminals
+					<< ", \"states\": " << result.states
+					<< ", \"phases\": {";
+				for (size_t i = 0; i < PHASE_COUNT; i++) {
+					out << (i == 0 ? "" : ", ") << json_string(PHASES[i])
+						<< ": {\"min_ms\": " << json_number(minimum(result.phase_ms[i]))
+						<< ", \"median_ms\": " << json_number(median(result.phase_ms[i])) << "}";
+				}
+				out << "}, \"total\": {\"min_ms\": " << json_number(minimum(result.total_ms))
+					<< ", \"median_ms\": " << json_number(median(result.total_ms)) << "}";
+
+				const parse::build_stats_t& stats = result.stats;
+				out << ", \"stats\": {\"kernel_items\": " << stats.kernel_items
+					<< ", \"closure_items\": " << stats.closure_items
+					<< ", \"lookaheads\": " << stats.lookaheads
+					<< ", \"first_set_passes\": " << stats.first_set_passes
+					<< ", \"closure_calls\": " << stats.closure_calls
+					<< ", \"closure_steps\": " << stats.closure_steps
+					<< ", \"propagation_edges\": " << stats.propagation_edges
+					<< ", \"propagation_steps\": " << stats.propagation_steps
+					<< ", \"arena_bytes\": " << stats.arena_bytes
+					<< ", \"link_bytes\": " << stats.link_bytes
+					<< ", \"peak_bytes\": " << stats.peak_bytes << "}";
+			}
+			out << "}";
+		}
+
+		out << "\n  ]\n}\n";
+		return out.str();
+	}
+
+	std::vector<size_t> parse_sizes(const std::string& list)
+	{
+		std::vector<size_t> sizes;
+		std::stringstream ss(list);
+		std::string item;
+		while (std::getline(ss, item, ',')) {
+			if (!item.empty())
+				sizes.push_back(std::stoul(item));
+		}
+		return sizes;
+	}
+
+	bool parse_options(int argc, char** argv, options_t& options)
+	{
+		for (int i = 1; i < argc; i++) {
+			std::string arg = argv[i];
+			if (i + 1 >= argc) {
+				std::cerr << "Missing value for " << arg << std::endl;
+				return false;
+			}
+			std::string value = argv[++i];
+
+			if (arg == "--family") {
+				bench::grammar_family_t family;
+				if (!bench::find_family(value, family)) {
+					std::cerr << "Unknown grammar family: " << value << std::endl;
+					return false;
+				}
+				options.families.push_back(family);
+			}
+			else if (arg == "--sizes")
+				options.sizes = parse_sizes(value);
+			else if (arg == "--repeat")
+				options.repeat = std::max<size_t>(1, std::stoul(value));
+			else if (arg == "--budget")
+				options.budget_seconds = std::stod(value);
+			else if (arg == "--output")
+				options.output = value;
+			else if (arg == "--emit")
+				options.emit_dir = value;
+			else if (arg == "--trace")
+				options.trace_dir = value;
+			else {
+				std::cerr << "Unknown option: " << arg << std::endl;
+				return false;
+			}
+		}
+
+		if (options.families.empty())
+			options.families = bench::all_families();
+		std::sort(options.sizes.begin(), options.sizes.end());
+		return true;
+	}
+
+}
+
+int main(int argc, char** argv)
+{
+	options_t options;
+	try {
+		if (!parse_options(argc, argv, options))
+			return 2;
+	}
+	catch (const std::exception&) {
+		std::cerr << "Invalid number in the options" << std::endl;
+		return 2;
+	}
+
+	// Grammars are kept so that the results can point at them
+	std::vector<std::unique_ptr<bench::synthetic_grammar_t>> grammars;
+	std::vector<result_t> results;
+
+	for (bench::grammar_family_t family : options.families) {
+		bool over_budget = false;
+
+		for (size_t size : options.sizes) {
+			grammars.push_back(std::make_unique<bench::synthetic_grammar_t>(bench::generate_grammar(family, size)));
+			const bench::synthetic_grammar_t& grammar = *grammars.back();
+
+			result_t result;
+			result.grammar = &grammar;
+			result.target = size;
+
+			if (!options.emit_dir.empty()) {
+				std::ofstream file(options.emit_dir + "/" + bench::family_name(family) + "_" + std::to_string(size) + ".txt");
+				file << grammar.text;
+			}
+
+			if (over_budget) {
+				result.status = "skipped";
+				results.push_back(std::move(result));
+				continue;
+			}
+
+			std::cerr << bench::family_name(family) << " " << grammar.productions << " productions: " << std::flush;
+			try {
+				for (size_t i = 0; i < options.repeat; i++) {
+					build_once(grammar, result);
+					if (result.total_ms.back() > options.budget_seconds * 1000)
+						break;
+				}
+				std::cerr << result.states << " states, " << json_number(minimum(result.total_ms)) << " ms" << std::endl;
+
+				if (!options.trace_dir.empty()) {
+					std::ofstream file(options.trace_dir + "/" + bench::family_name(family) + "_" + std::to_string(size) + ".trace.json");
+					file << result.stats.to_chrome_trace();
+				}
+			}
+			catch (const std::exception& e) {
+				result.status = e.what();
+				std::cerr << e.what() << std::endl;
+			}
+
+			over_budget = !result.total_ms.empty() && result.total_ms.back() > options.budget_seconds * 1000;
+			results.push_back(std::move(result));
+		}
+	}
+
+	std::string json = to_json(options, results);
+	if (options.output.empty()) {
+		std::cout << json;
+	}
+	else {
+		std::ofstream file(options.output);
+		if (!file) {
+			std::cerr << "Failed to open " << options.output << std::endl;
+			return 1;
+		}
+		file << json;
+	}
+
+	return 0;
+}
@@ -0,0 +1,172 @@
+#include "synthetic_grammar.h"
+
+
+namespace {
+
+	/* Appends a rule "left -> alternative | alternative ..." and counts its productions */
+	void add_rule(bench::synthetic_grammar_t& grammar, const std::string& left, const std::vector<std::string>& alternatives)
+	{
+		grammar.text += left + " ->";
+		for (size_t i = 0; i < alternatives.size(); i++)
+			grammar.text += (i == 0 ? " " : " | ") + alternatives[i];
+		grammar.text += "\n";
+		grammar.productions += alternatives.size();
+	}
+
+	/* Returns how many units of size per_unit fit into target after fixed productions, at least 1 */
+	size_t units_for(size_t target, size_t fixed, size_t per_unit)
+	{
+		return target > fixed + per_unit ? (target - fixed) / per_unit : 1;
+	}
+
+	/*
+	 * Prog -> Prog Stmt | Stmt
+	 * Stmt -> E0 ;
+	 * Ei -> Ei opi Ei+1 | Ei+1      (the last level uses P for Ei+1)
+	 * P -> id | num | ( E0 )
+	 */
+	void expression_tower(bench::synthetic_grammar_t& grammar, size_t target)
+	{
+		size_t levels = units_for(target, 6, 2);
+		grammar.parameter = levels;
+
+		add_rule(grammar, "Prog", { "Prog Stmt", "Stmt" });
+		add_rule(grammar, "Stmt", { "E0 ;" });
+		for (size_t i = 0; i < levels; i++) {
+			std::string self = "E" + std::to_string(i);
+			std::string next = i + 1 < levels ? "E" + std::to_string(i + 1) : "P";
+			add_rule(grammar, self, { self + " op" + std::to_string(i) + " " + next, next });
+		}
+		add_rule(grammar, "P", { "id", "num", "( E0 )" });
+	}
+
+	/*
+	 * Prog -> Prog Stmt | Stmt
+	 * Stmt -> kw0 Arg ; | kw1 Arg ; | ...
+	 * Arg -> id | num | ( Args )
+	 * Args -> Args , Arg | Arg
+	 */
+	void wide_alternation(bench::synthetic_grammar_t& grammar, size_t target)
+	{
+		size_t width = units_for(target, 7, 1);
+		grammar.parameter = width;
+
+		std::vector<std::string> statements;
+		for (size_t i = 0; i < width; i++)
+			statements.push_back("kw" + std::to_string(i) + " Arg ;");
+
+		add_rule(grammar, "Prog", { "Prog Stmt", "Stmt" });
+		add_rule(grammar, "Stmt", statements);
+		add_rule(grammar, "Arg", { "id", "num", "( Args )" });
+		add_rule(grammar, "Args", { "Args , Arg", "Arg" });
+	}
+
+	/*
+	 * Prog -> N0 end
+	 * Ni -> Oi Ni+1                 (the last one is just On-1)
+	 * Oi -> ai | epsilon
+	 */
+	void nullable_chain(bench::synthetic_grammar_t& grammar, size_t target)
+	{
+		size_t length = units_for(target, 1, 3);
+		grammar.parameter = length;
+
+		add_rule(grammar, "Prog", { "N0 end" });
+		for (size_t i = 0; i < length; i++) {
+			std::string optional = "O" + std::to_string(i);
+			add_rule(grammar, "N" + std::to_string(i), { i + 1 < length ? optional + " N" + std::to_string(i + 1) : optional });
+			add_rule(grammar, optional, { "a" + std::to_string(i), "epsilon" });
+		}
+	}
+
+	/*
+	 * Prog -> Prog Rec | Rec
+	 * Rec -> [ F0 , F1 , ... ]
+	 * Fi -> fi | fi = Val
+	 * Val -> id | num | [ Vals ]
+	 * Vals -> Vals , Val | Val
+	 */
+	void long_list(bench::synthetic_grammar_t& grammar, size_t target)
+	{
+		size_t fields = units_for(target, 8, 2);
+		grammar.parameter = fields;
+
+		std::string record = "[";
+		for (size_t i = 0; i < fields; i++)
+			record += (i == 0 ? " F" : " , F") + std::to_string(i);
+		record += " ]";
+
+		add_rule(grammar, "Prog", { "Prog Rec", "Rec" });
+		add_rule(grammar, "Rec", { record });
+		for (size_t i = 0; i < fields; i++) {
+			std::string name = "f" + std::to_string(i);
+			add_rule(grammar, "F" + std::to_string(i), { name, name + " = Val" });
+		}
+		add_rule(grammar, "Val", { "id", "num", "[ Vals ]" });
+		add_rule(grammar, "Vals", { "Vals , Val", "Val" });
+	}
+
+}
+
+
+const std::vector<bench::grammar_family_t>& bench::all_families()
+{
+	static const std::vector<grammar_family_t> families = {
+		grammar_family_t::EXPRESSION_TOWER,
+		grammar_family_t::WIDE_ALTERNATION,
+		grammar_family_t::NULLABLE_CHAIN,
+		grammar_family_t::LONG_LIST
+	};
+	return families;
+}
+
+const char* bench::family_name(grammar_family_t family)
+{
+	switch (family) {
+	case grammar_family_t::EXPRESSION_TOWER:
+		return "expression_tower";
+	case grammar_family_t::WIDE_ALTERNATION:
+		return "wide_alternation";
+	case grammar_family_t::NULLABLE_CHAIN:
+		return "nullable_chain";
+	case grammar_family_t::LONG_LIST:
+		return "long_list";
+	default:
+		return "unknown";
+	}
+}
+
+bool bench::find_family(std::string_view name, grammar_family_t& family)
+{
+	for (grammar_family_t f : all_families()) {
+		if (name == family_name(f)) {
+			family = f;
+			return true;
+		}
+	}
+	return false;
+}
+
+bench::synthetic_grammar_t bench::generate_grammar(grammar_family_t family, size_t target_productions)
+{
+	synthetic_grammar_t grammar;
+	grammar.family = family;
+	grammar.text = std::string("# Synthetic ") + family_name(family) + " grammar, about " + std::to_string(target_productions) + " productions\n";
+
+	switch (family) {
+	case grammar_family_t::EXPRESSION_TOWER:
+		expression_tower(grammar, target_productions);
+		break;
+	case grammar_family_t::WIDE_ALTERNATION:
+		wide_alternation(grammar, target_productions);
+		break;
+	case grammar_family_t::NULLABLE_CHAIN:
+		nullable_chain(grammar, target_productions);
+		break;
+	case grammar_family_t::LONG_LIST:
+		long_list(grammar, target_productions);
+		break;
+	}
+
+	return grammar;
+}
@@ -0,0 +1,46 @@
+#pragma once
+#ifndef __SYNTHETIC_GRAMMAR_H__
+#define __SYNTHETIC_GRAMMAR_H__
+
+#include <stddef.h>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace bench {
+
+	/* Shapes of synthetic grammars, each stressing another part of table construction */
+	enum class grammar_family_t {
+		EXPRESSION_TOWER,  // One non-terminal per precedence level: deep closures, long unit-reduction chains
+		WIDE_ALTERNATION,  // One non-terminal with many alternatives: wide closures and ACTION rows
+		NULLABLE_CHAIN,    // A chain of optional symbols: large FIRST sets built through nullable prefixes
+		LONG_LIST          // A record with many fields in one production: long right-hand sides, many kernels
+	};
+
+	/* A generated grammar in the grammar file format */
+	struct synthetic_grammar_t {
+		grammar_family_t family;
+		size_t parameter = 0;    // Levels, alternatives, chain length or fields, depending on the family
+		size_t productions = 0;  // Number of productions (alternatives counted one by one)
+		std::string text;        // Grammar file text
+	};
+
+	/* Returns all families, in the order they are reported */
+	const std::vector<grammar_family_t>& all_families();
+
+	/* Returns the name of a family as used on the command line and in reports */
+	const char* family_name(grammar_family_t family);
+
+	/* Looks a family up by name, returns false if there is none */
+	bool find_family(std::string_view name, grammar_family_t& family);
+
+	/*
+	 * Generates a conflict-free LALR(1) grammar of a family with about target_productions
+	 * productions (at least the few every grammar of the family has). The result depends
+	 * only on the arguments.
+	 */
+	synthetic_grammar_t generate_grammar(grammar_family_t family, size_t target_productions);
+
+}
+
+#endif
@@ -4,8 +4,12 @@
 
 #include "framework.h"
 #include "lr_parser.h"
+#include "grammar_loader.h"
+#include "grammar_registry.h"
+#include "source_buffer.h"
 
 #include <string>
+#include <string_view>
 #include <fstream>
 #include <iostream>
 
@@ -16,11 +20,19 @@ private:
 
 	std::unique_ptr<parse::lr_parser> parser;
 
+	bool streaming = false;  // Pull tokens from the lexer during parsing instead of tokenizing up front
+
 public:
 	compiler_frontend(const std::string& grammar_bnf) {
 
-		parser = std::make_unique<parse::lr_parser>(grammar_parser(grammar_bnf));
+		auto grammar = grammar_parser(grammar_bnf);
+		auto normalized = grammar->normalize();
+
+		parser = std::make_unique<parse::lr_parser>(std::move(grammar));
+		lex.use_grammar_keywords(*parser->grammar);
 #ifdef __DEBUG__
+		if (normalized.changed())
+			std::cout << "======== Normalization: \n" << normalized.to_string() << std::endl;
 		std::cout << "======== Grammar: \n" << *this->parser->grammar << std::endl;
 		std::cout << "======== Production: \n" << this->parser->grammar->productions_to_string() << std::endl;
 		std::cout << this->parser->grammar->action_table_to_string_detailed() << std::endl;
@@ -29,59 +41,93 @@ public:
 
 	}
 
-	bool compile(const std::string& code) {
-		
-
-
-		auto tokens = lex.tokenize(code);
-
-#ifdef __DEBUG__
-		for (const auto& p : tokens) {
-			std::cout << "Symbol: " << p.first.name << " , Lexeme: " << p.second << std::endl;
-		}
-#endif
-
-		auto parse_result = parser->parse(tokens);
+	/* Creates a frontend for a grammar that is already built, e.g. one from a grammar_registry */
+	explicit compiler_frontend(parse::grammar_handle grammar) {
 
-		std::cout << parser->parse_history_to_string() << std::endl;
+		parser = std::make_unique<parse::lr_parser>(std::move(grammar));
+		lex.use_grammar_keywords(*parser->grammar);
+	}
 
-		if (!parse_result.success) {
-			std::cerr << "Syntax errors found:\n";
-			std::cerr << parse_result.error_message << "\n";
-			return false;
-		}
+	/*
+	 * Enables or disables streaming mode
+	 * In streaming mode the parser pulls tokens from the lexer on demand, so the token list
+	 * is never materialized and token memory stays constant regardless of input size.
+	 */
+	void set_streaming(bool enabled) {
+		streaming = enabled;
+	}
 
-		std::cout << "Compilation successful!\n";
+	/*
+	 * Enables or disables context-aware lexing (streaming mode only)
+	 * Each token is lexed trying only the terminals the current parser state accepts.
+	 */
+	void set_context_aware_lexing(bool enabled) {
+		parser->set_context_aware_lexing(enabled);
+	}
 
-		return true;
+	bool compile(const std::string& code) {
+		return compile_source(code);
 	}
 
 
 
+	/*
+	 * Compiles a source file
+	 * The file is memory-mapped and lexed in place; in streaming mode it is parsed straight
+	 * from the mapping (or, if it cannot be mapped, through a bounded chunked reader).
+	 */
 	bool compile(const std::string& code_file, bool is_file) {
 		
 		if (!is_file)
 			return false;
 
-		std::ifstream infile;
-		infile.open(code_file);
+		parse::mapped_file_source mapped(code_file);
 
-		if (!infile.is_open())
+		if (mapped.is_open()) {
+			if (streaming)
+				return report(parser->parse(lex, mapped));
+			return compile_source(mapped.window());
+		}
+
+		parse::chunked_file_source chunked(code_file);
+
+		if (!chunked.is_open())
 		{
 			std::cerr << "Failed to open code file: " << code_file << std::endl;
+			return false;
 		}
-		std::string content((std::istreambuf_iterator<char>(infile)),
-			std::istreambuf_iterator<char>());
 
-		auto tokens = lex.tokenize(content);
+		if (streaming)
+			return report(parser->parse(lex, chunked));
+
+		std::string content;
+		while (!chunked.at_end())
+			chunked.refill(chunked.window_offset());
+		content.assign(chunked.window());
+
+		return compile_source(content);
+	}
+
+private:
+	/* Tokenizes and parses a source buffer; tokens reference the buffer instead of copying lexemes */
+	bool compile_source(std::string_view code) {
+
+		if (streaming)
+			return report(parser->parse(lex, code));
+
+		auto tokens = lex.tokenize_spans(code);
 
 #ifdef __DEBUG__
-		for (const auto& p : tokens) {
-			std::cout << "Symbol: " << p.first.name << " , Lexeme: " << p.second << std::endl;
+		for (const auto& t : tokens) {
+			std::cout << "Symbol: " << lex.symbol_of(t.terminal).name << " , Lexeme: " << t.lexeme(code) << std::endl;
 		}
 #endif
 
-		auto parse_result = parser->parse(tokens);
+		return report(parser->parse(tokens, lex));
+	}
+
+	/* Prints the parse history and the outcome of a parse */
+	bool report(const parse::lr_parser::parse_result& parse_result) {
 
 		std::cout << parser->parse_history_to_string() << std::endl;
 
@@ -1,9 +1,29 @@
 ﻿#include <iostream>
+#include <string>
 #include "lr_parser.h"
 #include "compiler_frontend.h"
 
-int main()
+/*
+ * Usage: demo                              Compiles a sample input with examples/gram_exp02.txt
+ *        demo --footprint GRAMMAR [TOP]    Builds a grammar and reports the size and shape of its
+ *                                          tables (see lalr_grammar::footprint), listing the TOP
+ *                                          productions in the most states (default 10)
+ */
+int main(int argc, char** argv)
 {
+	if (argc >= 3 && std::string(argv[1]) == "--footprint") {
+		try {
+			auto grammar = grammar_parser(argv[2]);
+			grammar->normalize();
+			grammar->build();
+			std::cout << grammar->footprint().to_string(argc >= 4 ? std::stoul(argv[3]) : 10);
+		}
+		catch (const std::exception& e) {
+			std::cerr << e.what() << std::endl;
+			return 1;
+		}
+		return 0;
+	}
 
 	compiler_frontend frontend = compiler_frontend("examples/gram_exp02.txt");
 	frontend.compile("x = 5 + 3");
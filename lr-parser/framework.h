@@ -3,3 +3,4 @@
 #define __DEBUG__								1
 //#define __DEBUG_OUTPUT__						1
 #define __LALR1_PARSER_HISTORY_INFO__			1
+#define __LALR1_PARSER_COUNTERS__				1
@@ -0,0 +1,106 @@
+#pragma once
+#ifndef __GRAMMAR_LOADER_H__
+#define __GRAMMAR_LOADER_H__
+
+#include "framework.h"
+#include "lr_parser.h"
+#include "string_pool.h"
+
+#include <stdint.h>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace parse {
+
+	constexpr uint32_t INVALID_GRAMMAR_SYMBOL = 0xFFFFFFFFu;
+
+	/*
+	 * Error in a grammar file
+	 * line() is the 1-based line the error was found on, or 0 if it concerns the whole file.
+	 */
+	class grammar_error : public std::runtime_error {
+	private:
+		size_t line_number;  // Line of the error, 0 if none
+
+	public:
+		grammar_error(const std::string& message, size_t line)
+			: std::runtime_error(line > 0 ? "Line " + std::to_string(line) + ": " + message : message),
+			line_number(line) {
+		}
+
+		/* Returns the line of the error, or 0 if it concerns the whole file */
+		size_t line() const {
+			return line_number;
+		}
+	};
+
+	/*
+	 * Contents of a grammar file in flat arrays
+	 *
+	 * Symbols are numbered densely in order of first appearance; their names are atoms of
+	 * names. Production p derives symbol production_left[p] to the symbols
+	 * rhs[rhs_begin[p] .. rhs_begin[p + 1]), so an epsilon production has an empty range.
+	 * Productions are numbered in file order.
+	 */
+	struct grammar_file_t {
+		parse::string_pool names;                        // Interned symbol names
+		std::vector<parse::atom_t> symbol_names;         // Name of each symbol
+		std::vector<parse::symbol_type_t> symbol_types;  // Type of each symbol (TERMINAL or NON_TERMINAL)
+		std::vector<uint32_t> production_left;           // Left-hand side of each production
+		std::vector<uint32_t> rhs_begin{ 0 };            // Start of each production's right-hand side in rhs, plus the end
+		std::vector<uint32_t> rhs;                       // Right-hand sides of all productions, concatenated
+		std::vector<uint32_t> production_lines;          // Line each production was read from
+		std::vector<uint32_t> production_precedence;     // Terminal given with %prec, INVALID_GRAMMAR_SYMBOL if none
+		std::vector<std::pair<uint32_t, parse::precedence_t>> precedences;  // Terminals declared with %left/%right/%nonassoc
+		uint32_t start_symbol = INVALID_GRAMMAR_SYMBOL;  // Left-hand side of the first production
+
+		/* Returns the number of productions */
+		size_t production_count() const {
+			return production_left.size();
+		}
+
+		/* Returns the number of distinct symbols */
+		size_t symbol_count() const {
+			return symbol_names.size();
+		}
+
+		/* Returns the name of a symbol */
+		std::string_view symbol_name(uint32_t symbol) const {
+			return names.str(symbol_names[symbol]);
+		}
+	};
+
+	/*
+	 * Loads a grammar file in one pass over a memory mapping of it
+	 *
+	 * Each non-empty line not starting with '#' is a production "Left -> Alt | Alt ...". The
+	 * arrow may be written "->" or as → in UTF-8 or GBK, and epsilon as "epsilon" or as ε in
+	 * UTF-8 or GBK. Symbols starting with an uppercase letter or written <name> are
+	 * non-terminals, all others terminals. Symbols are interned as they are read and
+	 * productions appended straight to the flat arrays.
+	 *
+	 * Lines "%left a b", "%right a b" and "%nonassoc a b" declare the precedence of
+	 * terminals, each line binding tighter than the lines before it. "%prec t" at the end of
+	 * an alternative gives that production the precedence of terminal t.
+	 *
+	 * A non-terminal directly followed by '*', '+' or '?' (e.g. Stmt*) is repeated zero or more
+	 * times, one or more times, or optional; so is a group "( Alt | Alt )*" whose closing
+	 * parenthesis is directly followed by the operator. Parentheses and operators standing
+	 * alone are terminals. Each such construct becomes a helper non-terminal named after it,
+	 * generated once with left-recursive productions appended after the line using it.
+	 * Throws grammar_error on the first malformed line, or if the file cannot be read.
+	 */
+	grammar_file_t load_grammar_file(const std::string& filename);
+
+	/* Loads a grammar from text in memory, see load_grammar_file() */
+	grammar_file_t load_grammar(std::string_view text);
+
+	/* Creates an LALR(1) grammar (tables not built yet) holding the productions of a loaded grammar file */
+	std::unique_ptr<parse::lalr_grammar> build_grammar(const grammar_file_t& file);
+
+}
+
+#endif
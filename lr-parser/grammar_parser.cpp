@@ -1,225 +1,416 @@
 #include "framework.h"
 #include "lr_parser.h"
+#include "grammar_loader.h"
+#include "simd_scan.h"
+#include "source_buffer.h"
 
-#include <iostream>
-#include <fstream>
+#include <cctype>
 #include <string>
+#include <string_view>
 #include <vector>
-#include <sstream>
-#include <algorithm>
-#include <map>
-#include <set>
-#include <cctype>
-#include <locale>
-#include <codecvt>
 
 
-static std::string trim(const std::string& str) {
-	size_t start = str.find_first_not_of(" \t\n\r");
-	size_t end = str.find_last_not_of(" \t\n\r");
-	if (start == std::string::npos || end == std::string::npos) {
-		return "";
-	}
-	return str.substr(start, end - start + 1);
-}
+namespace {
 
-static size_t find_arrow_position(const std::string& line)
-{
-	// Try to find different arrow representations
-	size_t pos = line.find("->");
-	if (pos != std::string::npos) return pos;
-	pos = line.find("");
-	if (pos != std::string::npos) return pos;
-	// Try to find UTF-8 encoded arrow (may be multi-byte character)
-	pos = line.find("\xE2\x86\x92"); // UTF-8 encoded 
-	if (pos != std::string::npos) return pos;
-	return std::string::npos;
-}
+	// Spellings of the arrow and of epsilon, in ASCII, GBK and UTF-8
+	constexpr std::string_view ARROWS[] = { "->", "\xA1\xFA", "\xE2\x86\x92" };
+	constexpr std::string_view EPSILONS[] = { "epsilon", "\xA6\xC5", "\xCE\xB5" };
 
-static size_t get_arrow_length(const std::string& line, size_t arrow_pos)
-{
-	if (arrow_pos == std::string::npos) return 0;
-	// Check if it's "->"
-	if (line.substr(arrow_pos, 2) == "->") return 2;
-	// Check if it's "" (single character)
-	if (line.substr(arrow_pos, 1) == "") return 1;
-	// Check if it's UTF-8 encoded  (three bytes)
-	if (arrow_pos + 2 < line.size() &&
-		line.substr(arrow_pos, 3) == "\xE2\x86\x92") return 3;
-	return 0;
-}
+	std::string_view trim(std::string_view s) {
+		size_t start = 0, end = s.size();
+		while (start < end && parse::simd::is_blank(s[start]))
+			start++;
+		while (end > start && parse::simd::is_blank(s[end - 1]))
+			end--;
+		return s.substr(start, end - start);
+	}
 
-static std::string to_valid_identifier(const std::string& name)
-{
-	if (name.empty()) return "empty";
-	std::string result;
-	for (char c : name) {
-		if (std::isalnum(static_cast<unsigned char>(c))) {
-			result += c;
-		}
-		else {
-			result += '_';
+	bool is_epsilon(std::string_view symbol) {
+		for (std::string_view e : EPSILONS) {
+			if (symbol == e)
+				return true;
 		}
+		return false;
 	}
-	// If it starts with a digit, add a prefix
-	if (!result.empty() && std::isdigit(static_cast<unsigned char>(result[0]))) {
-		result = "NT_" + result;
+
+	bool is_angle_bracketed(std::string_view symbol) {
+		return symbol.size() >= 2 && symbol.front() == '<' && symbol.back() == '>';
 	}
-	return result;
-}
 
-static std::vector<std::string> split(const std::string& str, char delimiter)
-{
-	std::vector<std::string> tokens;
-	std::string token;
-	std::istringstream tokenStream(str);
-	while (std::getline(tokenStream, token, delimiter)) {
-		token = trim(token);
-		if (!token.empty()) {
-			tokens.push_back(token);
-		}
+	bool is_repetition_operator(char c) {
+		return c == '*' || c == '+' || c == '?';
 	}
-	return tokens;
-}
 
-static bool is_non_terminal(const std::string& symbol)
-{
-	if (symbol.empty()) return false;
-	if (symbol == "" || symbol == "epsilon") return true;
-	// Check if it's enclosed in <>
-	if (symbol.size() >= 2 && symbol[0] == '<' && symbol[symbol.size() - 1] == '>') {
-		return true;
+	/* Returns whether a right-hand side token names a non-terminal, possibly followed by *, + or ? */
+	bool names_non_terminal(std::string_view token) {
+		while (token.size() >= 2 && is_repetition_operator(token.back()))
+			token.remove_suffix(1);
+		return is_angle_bracketed(token) || std::isupper(static_cast<unsigned char>(token[0]));
 	}
-	// Check if it starts with an uppercase letter
-	return std::isupper(static_cast<unsigned char>(symbol[0]));
-}
 
-static std::string extract_symbol_name(const std::string& symbol)
-{
-	if (symbol.size() >= 2 && symbol[0] == '<' && symbol[symbol.size() - 1] == '>') {
-		return symbol.substr(1, symbol.size() - 2);
+	/* Returns the position of the first arrow in a line and sets its length, or npos if there is none */
+	size_t find_arrow(std::string_view line, size_t& length) {
+		for (std::string_view arrow : ARROWS) {
+			size_t pos = line.find(arrow);
+			if (pos != std::string_view::npos) {
+				length = arrow.size();
+				return pos;
+			}
+		}
+		return std::string_view::npos;
 	}
-	return symbol;
-}
 
+	/* Scans grammar text line by line, interning symbols and appending productions to a grammar_file_t */
+	class grammar_scanner {
+	private:
+		parse::grammar_file_t& out;
+		std::vector<uint32_t> terminal_of_atom;                   // Terminal symbol named by each atom
+		std::vector<uint32_t> non_terminal_of_atom;               // Non-terminal symbol named by each atom
+		size_t line = 0;                                          // Line being scanned
+		int precedence_level = 0;                                 // Level of the last precedence declaration
+
+		struct alternative_t {
+			std::vector<uint32_t> symbols;                        // Right-hand side
+			uint32_t precedence = parse::INVALID_GRAMMAR_SYMBOL;  // Terminal given with %prec, if any
+		};
+		using alternatives_t = std::vector<alternative_t>;
+
+		std::vector<std::string_view> tokens;                     // Tokens of the right-hand side being scanned
+		std::vector<size_t> group_close;                          // Index of the token closing the group each token opens, 0 if none
+		std::vector<size_t> open_groups;                          // Parentheses not closed yet while matching groups
+		alternatives_t alternatives;                              // Alternatives of the line being scanned
+		std::vector<std::pair<uint32_t, alternative_t>> helpers;  // Productions of helpers generated on the line being scanned
+		std::vector<bool> generated;                              // Whether each symbol is a helper already generated
+
+		[[noreturn]] void error(const std::string& message) const {
+			throw parse::grammar_error(message, line);
+		}
 
-std::unique_ptr<parse::lalr_grammar> grammar_parser(const std::string& filename) {
+		/* Returns the symbol with the given name and type, numbering it on first appearance */
+		uint32_t symbol(std::string_view name, parse::symbol_type_t type) {
+			parse::atom_t atom = out.names.intern(name);
+			if (atom >= terminal_of_atom.size()) {
+				terminal_of_atom.resize(atom + 1, parse::INVALID_GRAMMAR_SYMBOL);
+				non_terminal_of_atom.resize(atom + 1, parse::INVALID_GRAMMAR_SYMBOL);
+			}
 
+			uint32_t& slot = type == parse::symbol_type_t::NON_TERMINAL ? non_terminal_of_atom[atom] : terminal_of_atom[atom];
+			if (slot == parse::INVALID_GRAMMAR_SYMBOL) {
+				slot = static_cast<uint32_t>(out.symbol_names.size());
+				out.symbol_names.push_back(atom);
+				out.symbol_types.push_back(type);
+			}
+			return slot;
+		}
 
-	std::unique_ptr<parse::lalr_grammar> grammar = std::make_unique<parse::lalr_grammar>();
+		/* Returns the symbol written as token; a non-terminal followed by *, + or ? stands for a generated helper */
+		uint32_t symbol_of(std::string_view token) {
+			if (token.size() >= 2 && is_repetition_operator(token.back())) {
+				std::string_view operand = token.substr(0, token.size() - 1);
+				if (names_non_terminal(operand)) {
+					uint32_t symbol = symbol_of(operand);
+					alternatives_t body(1);
+					body[0].symbols.push_back(symbol);
+					return repetition(std::string(token), body, token.back());
+				}
+			}
 
-	std::ifstream file(filename);
+			bool bracketed = is_angle_bracketed(token);
+			std::string_view name = bracketed ? token.substr(1, token.size() - 2) : token;
+			if (name.empty())
+				error("Invalid symbol: " + std::string(token));
 
-	if (!file.is_open())
-	{
-		std::cerr << "Failed to open grammar file: " << filename << std::endl;
-	}
+			bool non_terminal = bracketed || std::isupper(static_cast<unsigned char>(token[0]));
+			return symbol(name, non_terminal ? parse::symbol_type_t::NON_TERMINAL : parse::symbol_type_t::TERMINAL);
+		}
 
+		/*
+		 * Returns the helper non-terminal named name for the alternatives of body repeated by op,
+		 * generating its productions the first time. Repetition is left-recursive, so the parser
+		 * reduces after every element and its stack does not grow with the length of a list:
+		 *   H* -> H* body | epsilon    H+ -> H+ body | body    H? -> body | epsilon
+		 */
+		uint32_t repetition(const std::string& name, const alternatives_t& body, char op) {
+			uint32_t helper = symbol(name, parse::symbol_type_t::NON_TERMINAL);
+			if (helper >= generated.size())
+				generated.resize(helper + 1, false);
+			if (generated[helper])
+				return helper;
+			generated[helper] = true;
+
+			if (op != '?') {
+				for (const alternative_t& alt : body) {
+					alternative_t production;
+					production.symbols.push_back(helper);
+					production.symbols.insert(production.symbols.end(), alt.symbols.begin(), alt.symbols.end());
+					helpers.emplace_back(helper, std::move(production));
+				}
+			}
+			if (op != '*') {
+				for (const alternative_t& alt : body)
+					helpers.emplace_back(helper, alt);
+			}
+			if (op != '+')
+				helpers.emplace_back(helper, alternative_t());
+			return helper;
+		}
 
-	std::string line;
-	bool first_production = true;
+		/* Splits the right-hand side of a production into tokens; | is a token of its own even when not blank-separated */
+		void tokenize(std::string_view right) {
+			tokens.clear();
+			size_t pos = 0;
+			while (true) {
+				pos = parse::simd::skip_blanks(right.data(), pos, right.size());
+				if (pos >= right.size())
+					break;
+
+				size_t end = pos + 1;
+				if (right[pos] != '|') {
+					while (end < right.size() && right[end] != '|' && !parse::simd::is_blank(right[end]))
+						end++;
+				}
+				tokens.push_back(right.substr(pos, end - pos));
+				pos = end;
+			}
 
-	while (std::getline(file, line)) {
+			// a "(" is a group if it is closed by ")*", ")+" or ")?"; otherwise parentheses are terminals
+			group_close.assign(tokens.size(), 0);
+			open_groups.clear();
+			for (size_t i = 0; i < tokens.size(); i++) {
+				if (tokens[i] == "(") {
+					open_groups.push_back(i);
+				}
+				else if (tokens[i] == ")") {
+					if (!open_groups.empty())
+						open_groups.pop_back();
+				}
+				else if (tokens[i].size() == 2 && tokens[i][0] == ')' && is_repetition_operator(tokens[i][1])) {
+					if (open_groups.empty())
+						error("Unmatched " + std::string(tokens[i]));
+					group_close[open_groups.back()] = i;
+					open_groups.pop_back();
+				}
+			}
+		}
 
-		// trim the line
-		line = trim(line);
+		/* Parses the alternatives in tokens[begin, end) */
+		void parse_alternatives(size_t begin, size_t end, alternatives_t& alternatives, bool top_level) {
+			alternatives.emplace_back();
+			bool expect_precedence = false;
+
+			for (size_t i = begin; i < end; i++) {
+				std::string_view token = tokens[i];
+				if (token == "|") {
+					if (expect_precedence)
+						error("%prec without a terminal");
+					alternatives.emplace_back();
+					continue;
+				}
 
-		// skip empty lines and comments
-		if (line.empty() || line[0] == '#') {
-			continue;
+				alternative_t& alt = alternatives.back();
+				if (expect_precedence) {
+					alt.precedence = symbol(token, parse::symbol_type_t::TERMINAL);
+					expect_precedence = false;
+				}
+				else if (token == "%prec") {
+					if (!top_level)
+						error("%prec inside a group");
+					if (alt.precedence != parse::INVALID_GRAMMAR_SYMBOL)
+						error("More than one %prec in an alternative");
+					expect_precedence = true;
+				}
+				else if (alt.precedence != parse::INVALID_GRAMMAR_SYMBOL) {
+					error("%prec must end its alternative");
+				}
+				else if (group_close[i] != 0) {
+					size_t close = group_close[i];
+					std::string name(token);
+					for (size_t j = i + 1; j <= close; j++)
+						name.append(" ").append(tokens[j]);
+
+					alternatives_t body;
+					parse_alternatives(i + 1, close, body, false);
+					for (const alternative_t& b : body) {
+						if (b.symbols.empty())
+							error("Empty alternative in group " + name);
+					}
+					alt.symbols.push_back(repetition(name, body, tokens[close][1]));
+					i = close;
+				}
+				else if (!is_epsilon(token)) {
+					alt.symbols.push_back(symbol_of(token));
+				}
+			}
+
+			if (expect_precedence)
+				error("%prec without a terminal");
 		}
 
-		// find the arrow position
-		size_t arrow_pos = find_arrow_position(line);
-		if (arrow_pos == std::string::npos) {
-			std::cerr << "Error: Invalid production format (no arrow found): " << line << std::endl;
-			continue;
+		void add_production(uint32_t left, const alternative_t& alt) {
+			out.production_left.push_back(left);
+			out.production_precedence.push_back(alt.precedence);
+			out.rhs.insert(out.rhs.end(), alt.symbols.begin(), alt.symbols.end());
+			out.rhs_begin.push_back(static_cast<uint32_t>(out.rhs.size()));
+			out.production_lines.push_back(static_cast<uint32_t>(line));
 		}
 
-		size_t arrow_len = get_arrow_length(line, arrow_pos);
-		if (arrow_len == 0) {
-			std::cerr << "Error: Invalid arrow format: " << line << std::endl;
-			continue;
+		/* Returns the next blank-separated token of s from pos on (empty at the end) and advances pos past it */
+		static std::string_view next_word(std::string_view s, size_t& pos) {
+			pos = parse::simd::skip_blanks(s.data(), pos, s.size());
+			size_t end = pos;
+			while (end < s.size() && !parse::simd::is_blank(s[end]))
+				end++;
+			std::string_view word = s.substr(pos, end - pos);
+			pos = end;
+			return word;
 		}
 
-		std::string left_str = trim(line.substr(0, arrow_pos));
-		std::string right_str = trim(line.substr(arrow_pos + arrow_len));
+		/* Handles a %left, %right or %nonassoc line */
+		void scan_precedence(std::string_view s) {
+			size_t pos = 0;
+			std::string_view directive = next_word(s, pos);
+
+			parse::associativity_t assoc;
+			if (directive == "%left")
+				assoc = parse::associativity_t::LEFT;
+			else if (directive == "%right")
+				assoc = parse::associativity_t::RIGHT;
+			else if (directive == "%nonassoc")
+				assoc = parse::associativity_t::NONASSOC;
+			else
+				error("Unknown directive: " + std::string(directive));
+
+			precedence_level++;
+			size_t declared = 0;
+			for (std::string_view name = next_word(s, pos); !name.empty(); name = next_word(s, pos)) {
+				uint32_t terminal = symbol(name, parse::symbol_type_t::TERMINAL);
+				for (const auto& p : out.precedences) {
+					if (p.first == terminal)
+						error("Precedence of " + std::string(name) + " declared twice");
+				}
+				out.precedences.push_back({ terminal, { precedence_level, assoc } });
+				declared++;
+			}
 
-		// extract the left non-terminal
-		std::string left_symbol = extract_symbol_name(left_str);
-		if (left_symbol.empty()) {
-			std::cerr << "Error: Invalid left symbol: " << left_str << std::endl;
-			continue;
+			if (declared == 0)
+				error("No terminals in " + std::string(directive) + " declaration");
 		}
 
-		// set the start symbol (the first non-terminal)
-		if (first_production) {
-			first_production = false;
-			grammar->start_symbol = parse::symbol_t(left_symbol, parse::symbol_type_t::NON_TERMINAL);
-		}
+		void scan_line(std::string_view text) {
+			std::string_view s = trim(text);
 
-		// record the non-terminal
-		grammar->non_terminals.insert(parse::symbol_t(left_symbol, parse::symbol_type_t::NON_TERMINAL));
+			// skip empty lines and comments
+			if (s.empty() || s[0] == '#')
+				return;
 
-		// handle multiple productions on the right side (separated by |)
-		std::vector<std::string> alternatives;
-		size_t pipe_pos = right_str.find('|');
+			if (s[0] == '%') {
+				scan_precedence(s);
+				return;
+			}
 
-		if (pipe_pos == std::string::npos) {
-			alternatives.push_back(right_str);
+			size_t arrow_length = 0;
+			size_t arrow_pos = find_arrow(s, arrow_length);
+			if (arrow_pos == std::string_view::npos)
+				error("Invalid production format (no arrow found): " + std::string(s));
+
+			// extract the left non-terminal
+			std::string_view left_str = trim(s.substr(0, arrow_pos));
+			std::string_view left_name = is_angle_bracketed(left_str) ? left_str.substr(1, left_str.size() - 2) : left_str;
+			bool has_blank = false;
+			for (char c : left_name)
+				has_blank = has_blank || parse::simd::is_blank(c);
+			if (left_name.empty() || has_blank || is_repetition_operator(left_name.back()))
+				error("Invalid left symbol: " + std::string(left_str));
+
+			uint32_t left = symbol(left_name, parse::symbol_type_t::NON_TERMINAL);
+			if (out.start_symbol == parse::INVALID_GRAMMAR_SYMBOL)
+				out.start_symbol = left;
+
+			// each alternative (separated by |) becomes a production, followed by the helpers generated for it
+			tokenize(s.substr(arrow_pos + arrow_length));
+			alternatives.clear();
+			parse_alternatives(0, tokens.size(), alternatives, true);
+
+			for (const alternative_t& alt : alternatives)
+				add_production(left, alt);
+			for (const auto& helper : helpers)
+				add_production(helper.first, helper.second);
+			helpers.clear();
 		}
-		else {
-			// split multiple productions
-			size_t start = 0;
-			while (pipe_pos != std::string::npos) {
-				alternatives.push_back(trim(right_str.substr(start, pipe_pos - start)));
-				start = pipe_pos + 1;
-				pipe_pos = right_str.find('|', start);
-			}
-			alternatives.push_back(trim(right_str.substr(start)));
+
+	public:
+		explicit grammar_scanner(parse::grammar_file_t& file) : out(file) {
 		}
 
-		// handle each production
-		for (const auto& alt : alternatives) {
-			std::vector<parse::symbol_t> right_symbols;
-			if (alt == "" || alt == "epsilon" || alt.empty()) {
-				// empty production
-				right_symbols.push_back(grammar->epsilon);
+		void scan(std::string_view text) {
+			size_t pos = 0;
+			while (pos < text.size()) {
+				size_t end = parse::simd::find_byte(text.data(), pos, text.size(), '\n');
+				line++;
+				scan_line(text.substr(pos, end - pos));
+				pos = end + 1;
 			}
-			else {
-				// split the right side symbols by space
-				std::vector<std::string> tokens = split(alt, ' ');
-				for (const auto& token : tokens) {
-					std::string symbol_name = extract_symbol_name(token);
-					if (symbol_name.empty()) {
-						std::cerr << "Error: Invalid symbol: " << token << std::endl;
-						continue;
-					}
-					parse::symbol_t symbol;
-					if (is_non_terminal(token)) {
-						symbol = parse::symbol_t(symbol_name, parse::symbol_type_t::NON_TERMINAL);
-						grammar->non_terminals.insert(symbol);
-					}
-					else {
-						symbol = parse::symbol_t(symbol_name, parse::symbol_type_t::TERMINAL);
-						if (!(symbol == grammar->epsilon)) {
-							grammar->terminals.insert(symbol);
-						}
-					}
-					right_symbols.push_back(symbol);
-				}
-			}
-			// add to the production set
-			grammar->add_production(
-				parse::symbol_t(left_symbol, parse::symbol_type_t::NON_TERMINAL),
-				right_symbols
-			);
+
+			if (out.production_count() == 0)
+				throw parse::grammar_error("Grammar has no productions", 0);
 		}
+	};
 
-	}
+}
 
-	file.close();
+
+parse::grammar_file_t parse::load_grammar(std::string_view text)
+{
+	grammar_file_t file;
+	grammar_scanner(file).scan(text);
+	return file;
+}
+
+parse::grammar_file_t parse::load_grammar_file(const std::string& filename)
+{
+	mapped_file_source mapped(filename);
+	if (!mapped.is_open())
+		throw grammar_error("Failed to open grammar file: " + filename, 0);
+
+	return load_grammar(mapped.window());
+}
+
+std::unique_ptr<parse::lalr_grammar> parse::build_grammar(const grammar_file_t& file)
+{
+	std::unique_ptr<parse::lalr_grammar> grammar = std::make_unique<parse::lalr_grammar>();
+
+	// one symbol_t per distinct symbol, copied into the productions
+	std::vector<parse::symbol_t> symbols;
+	symbols.reserve(file.symbol_count());
+	for (uint32_t i = 0; i < file.symbol_count(); i++)
+		symbols.emplace_back(std::string(file.symbol_name(i)), file.symbol_types[i]);
+
+	if (file.start_symbol != INVALID_GRAMMAR_SYMBOL)
+		grammar->start_symbol = symbols[file.start_symbol];
+
+	for (const auto& p : file.precedences)
+		grammar->set_precedence(symbols[p.first], p.second.level, p.second.assoc);
+
+	std::vector<parse::symbol_t> right;
+	for (size_t p = 0; p < file.production_count(); p++) {
+		right.clear();
+		for (uint32_t i = file.rhs_begin[p]; i < file.rhs_begin[p + 1]; i++)
+			right.push_back(symbols[file.rhs[i]]);
+
+		// empty production
+		if (right.empty())
+			right.push_back(grammar->epsilon);
+
+		auto prod = grammar->add_production(symbols[file.production_left[p]], right);
+		if (file.production_precedence[p] != INVALID_GRAMMAR_SYMBOL)
+			prod->precedence_symbol = symbols[file.production_precedence[p]];
+	}
 
 	return grammar;
 }
 
+
+std::unique_ptr<parse::lalr_grammar> grammar_parser(const std::string& filename) {
+
+	return parse::build_grammar(parse::load_grammar_file(filename));
+}
@@ -0,0 +1,146 @@
+#include "framework.h"
+#include "grammar_registry.h"
+#include "grammar_loader.h"
+#include "source_buffer.h"
+
+#include <chrono>
+#include <exception>
+
+
+namespace {
+
+	/* FNV-1a hash of a grammar text */
+	uint64_t hash_text(std::string_view text) {
+		uint64_t h = 0xCBF29CE484222325ull;
+		for (unsigned char c : text) {
+			h ^= c;
+			h *= 0x100000001B3ull;
+		}
+		return h;
+	}
+
+}
+
+
+parse::grammar_registry::grammar_registry(size_t thread_count)
+{
+	if (thread_count == 0)
+		thread_count = std::max<size_t>(1, std::thread::hardware_concurrency());
+
+	workers.reserve(thread_count);
+	for (size_t i = 0; i < thread_count; i++)
+		workers.emplace_back(&grammar_registry::work, this);
+}
+
+parse::grammar_registry::~grammar_registry()
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stopping = true;
+	}
+	work_available.notify_all();
+
+	for (auto& worker : workers)
+		worker.join();
+}
+
+void parse::grammar_registry::work()
+{
+	while (true) {
+		std::function<void()> job;
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			work_available.wait(lock, [this] { return stopping || !jobs.empty(); });
+			if (jobs.empty())
+				return;
+
+			job = std::move(jobs.front());
+			jobs.pop_front();
+		}
+		job();
+	}
+}
+
+std::shared_future<parse::grammar_handle> parse::grammar_registry::load(std::string_view text)
+{
+	uint64_t h = hash_text(text);
+
+	std::shared_ptr<std::promise<grammar_handle>> promise;
+	std::shared_future<grammar_handle> result;
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+
+		std::vector<cache_entry_t>& bucket = cache[h];
+		for (const auto& entry : bucket) {
+			if (entry.text == text)
+				return entry.grammar;
+		}
+
+		promise = std::make_shared<std::promise<grammar_handle>>();
+		result = promise->get_future().share();
+		bucket.push_back({ std::string(text), result });
+		entries++;
+
+		// the job builds from its own copy of the text; the handle becomes const once it is built
+		jobs.push_back([promise, source = std::string(text)]() {
+			try {
+				std::unique_ptr<lalr_grammar> grammar = build_grammar(load_grammar(source));
+				grammar->normalize();
+				grammar->build();
+				promise->set_value(std::move(grammar));
+			}
+			catch (...) {
+				promise->set_exception(std::current_exception());
+			}
+		});
+	}
+	work_available.notify_one();
+
+	return result;
+}
+
+std::shared_future<parse::grammar_handle> parse::grammar_registry::load_file(const std::string& filename)
+{
+	mapped_file_source mapped(filename);
+	if (!mapped.is_open())
+		throw grammar_error("Failed to open grammar file: " + filename, 0);
+
+	return load(mapped.window());
+}
+
+std::shared_future<parse::grammar_handle> parse::grammar_registry::add(const std::string& name, std::string_view text)
+{
+	std::shared_future<grammar_handle> result = load(text);
+
+	std::lock_guard<std::mutex> lock(mutex);
+	names[name] = result;
+	return result;
+}
+
+parse::grammar_handle parse::grammar_registry::find(const std::string& name) const
+{
+	std::shared_future<grammar_handle> build;
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		auto it = names.find(name);
+		if (it == names.end())
+			return nullptr;
+		build = it->second;
+	}
+
+	if (build.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+		return nullptr;
+
+	try {
+		return build.get();
+	}
+	catch (...) {
+		return nullptr;
+	}
+}
+
+size_t parse::grammar_registry::size() const
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	return entries;
+}
@@ -0,0 +1,88 @@
+#pragma once
+#ifndef __GRAMMAR_REGISTRY_H__
+#define __GRAMMAR_REGISTRY_H__
+
+#include "framework.h"
+#include "lr_parser.h"
+
+#include <stdint.h>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+namespace parse {
+
+	/* Shared, immutable grammar whose tables are built */
+	using grammar_handle = std::shared_ptr<const lalr_grammar>;
+
+	/*
+	 * Builds grammars on a pool of worker threads and shares the results
+	 *
+	 * Grammars are cached by a hash of their text, so loading text that was loaded before
+	 * returns the finished build, or the build in progress, instead of starting another. Builds
+	 * only run on the workers: loading a grammar never blocks threads parsing with grammars
+	 * already handed out. Every grammar is normalized before its tables are built, as in
+	 * compiler_frontend.
+	 * Handles stay valid after the registry is destroyed and may be shared by any number of
+	 * lr_parser instances on any threads.
+	 */
+	class grammar_registry {
+	private:
+		struct cache_entry_t {
+			std::string text;                            // Grammar text, compared when hashes collide
+			std::shared_future<grammar_handle> grammar;  // Result of the build
+		};
+
+		mutable std::mutex mutex;                                                   // Guards the members below
+		std::condition_variable work_available;                                     // Signalled when a job is queued or on shutdown
+		std::deque<std::function<void()>> jobs;                                     // Builds waiting for a worker
+		std::unordered_map<uint64_t, std::vector<cache_entry_t>> cache;             // Builds by hash of the grammar text
+		std::unordered_map<std::string, std::shared_future<grammar_handle>> names;  // Builds registered under a name
+		size_t entries = 0;                                                         // Number of distinct texts in cache
+		bool stopping = false;                                                      // Set by the destructor
+		std::vector<std::thread> workers;                                           // Worker threads
+
+		/* Runs queued jobs until the registry stops */
+		void work();
+
+	public:
+		/* Starts thread_count workers, or one per hardware thread if 0 */
+		explicit grammar_registry(size_t thread_count = 0);
+
+		/* Finishes the builds already queued, then joins the workers */
+		~grammar_registry();
+
+		grammar_registry(const grammar_registry&) = delete;
+		grammar_registry& operator=(const grammar_registry&) = delete;
+
+		/*
+		 * Queues a build of a grammar given as the text of a grammar file, unless the same text
+		 * was loaded before. get() on the result waits for the build; it rethrows grammar_error
+		 * for a malformed grammar and std::runtime_error for one with conflicts.
+		 */
+		std::shared_future<grammar_handle> load(std::string_view text);
+
+		/* Reads a grammar file and loads its text, see load(). Throws grammar_error if the file cannot be read */
+		std::shared_future<grammar_handle> load_file(const std::string& filename);
+
+		/* Loads a grammar and registers it under a name, replacing the grammar registered under it before */
+		std::shared_future<grammar_handle> add(const std::string& name, std::string_view text);
+
+		/* Returns the grammar registered under a name once its build has succeeded, nullptr otherwise; never waits */
+		grammar_handle find(const std::string& name) const;
+
+		/* Returns the number of distinct grammar texts loaded */
+		size_t size() const;
+	};
+
+}
+
+#endif
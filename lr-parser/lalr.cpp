@@ -9,11 +9,12 @@
 #include <algorithm>
 #include <map>
 #include <set>
+#include <tuple>
 #include <cctype>
 #include <locale>
 #include <codecvt>
+#include <numeric>
 
-production_id_t parse::production_t::prod_id_size = 1;
 
 
 /*
@@ -27,9 +28,11 @@ production_id_t parse::production_t::prod_id_size = 1;
 3. **Handling the  case**: If all symbols in the production can derive , add  to the FIRST set of the left nonterminal
 */
 void parse::lalr_grammar::comp_first_sets() {
+	build_stats_t::scoped_phase phase(stats, "comp_first_sets");
 	bool changed = true;
 	do {
 		changed = false;
+		stats.first_set_passes++;
 
 		// Iterate over all productions
 		for (const auto& [left, prods] : productions) {
@@ -145,121 +148,34 @@ std::shared_ptr<parse::lalr1_item_set> parse::lalr_grammar::closure(const parse:
 	if (I.items.empty())
 		return std::make_shared<lalr1_item_set>();
 
-	std::shared_ptr<lalr1_item_set> new_I = std::make_shared<lalr1_item_set>(I);
-	std::unordered_map<lalr1_item_t, bool, lalr1_item_hasher> item_handled;
+	std::unique_ptr<lalr1_closure_arena> local;
+	lalr1_closure_arena& scratch = closure_arena(local);
+	const frozen_grammar& g = scratch.frozen();
 
-	bool changed = true;
-
-	do
-	{
-		changed = false;
-
-		// Copy current items to avoid modification during iteration
-		std::unordered_set<lalr1_item_t, lalr1_item_hasher> current_items = new_I->get_items();
-
-		for (const parse::lalr1_item_t& item : current_items) {
-
-#ifdef __DEBUG_OUTPUT__
-			//std::cout << "Current item: " << item.to_string() << std::endl;
-#endif
-
-			auto it_handled = item_handled.find(item);
-			if (it_handled != item_handled.end() && it_handled->second) {
-				continue; // Already processed
-			}
-
-			item_handled[item] = true; // Mark as processed
-
-
-			parse::symbol_t next_sym = item.next_symbol();
-
-			if (next_sym.type == parse::symbol_type_t::NON_TERMINAL && !next_sym.name.empty()) {
-
-				// add new items for each production of next_sym
-				std::vector<std::shared_ptr<parse::production_t>> prods = get_productions_for(next_sym);
-
-
-				// compute beta a (the right part after the non-terminal and the lookaheads)
-				std::vector<parse::symbol_t> beta_a;
-				for (int i = item.dot_pos + 1; i < item.product->right.size(); i++) {
-					beta_a.push_back(item.product->right[i]);
-				}
-				// compute FIRST(beta a)
-				std::unordered_set<parse::symbol_t, parse::symbol_hasher> lookaheads =
-					comp_first_of_sequence(beta_a, item.lookaheads);
-				// merge with existing lookaheads
-				lookaheads.insert(item.lookaheads.begin(), item.lookaheads.end());
-
-
-
-				for (const std::shared_ptr<parse::production_t> prod : prods) {
-
-					int next_sym_prod_dot_pos = 0;
-					bool all_can_derive_epsilon = true;
-
-					while (next_sym_prod_dot_pos < prod->right.size() && all_can_derive_epsilon) {
-						parse::symbol_t current_sym = prod->right[next_sym_prod_dot_pos];
-						parse::lalr1_item_t new_item(prod, next_sym_prod_dot_pos, lookaheads);
-
-						const lalr1_item_t* existing_item = new_I->find_item_by_id(new_item.id);
-						if (existing_item != nullptr) {
-
-							// Item with same core exists, merge lookaheads
-							new_I->add_lookaheads_for_item(new_item.id, lookaheads);
-
-						}
-						else {
-							// New item, simply add it
-							//new_I->items.insert(new_item);
-							new_I->add_items(new_item);
-							changed = true;
-						}
-
-						if (current_sym.type != parse::symbol_type_t::NON_TERMINAL) {
-							all_can_derive_epsilon = false;
-							break;
-						}
-
-						bool can_derive_epsilon = false;
-						if (first_sets.count(current_sym)) {
-							const auto& current_sym_first_sym = first_sets.at(current_sym);
-
-							if (current_sym_first_sym.find(epsilon) != current_sym_first_sym.end()) {
-								can_derive_epsilon = true;
-
-								std::vector<std::shared_ptr<parse::production_t>> sub_prods = get_productions_for(current_sym);
-								for (const auto& sub_prod : sub_prods) {
-									parse::lalr1_item_t sub_new_item(sub_prod, 0, lookaheads);
-
-									const parse::lalr1_item_t* found = new_I->find_item_by_id(sub_new_item.id);
-									if (found == nullptr) {
-										new_I->add_items(sub_new_item);
-										changed = true;
-									}
-									else
-									{
-										new_I->add_lookaheads_for_item(sub_new_item.id, lookaheads);
-									}
-								}
-
-							}
-						}
-
-						if (!can_derive_epsilon) {
-							all_can_derive_epsilon = false;
-							break;
-						}
-
-
-						next_sym_prod_dot_pos++;
-					}
-
-				}
-
-			}
+	scratch.clear();
+	for (const auto& item : I.items) {
+		frozen_grammar::item_index_t index = g.item_of(item);
+		if (index == frozen_grammar::INVALID_INDEX)
+			throw std::runtime_error("Closure of an item whose production is not in the grammar: " + item.to_string());
+
+		lalr1_closure_arena::word_t* row = scratch.add_kernel(index);
+		for (const auto& la : item.lookaheads) {
+			size_t column = scratch.column_of(la);
+			if (column < scratch.column_count())
+				lalr1_closure_arena::set(row, column);
 		}
-
-	} while (changed);
+	}
+	stats.closure_calls++;
+	stats.closure_steps += scratch.close();
+
+	std::shared_ptr<lalr1_item_set> new_I = std::make_shared<lalr1_item_set>(I.id);
+	for (size_t k = 0; k < scratch.size(); k++) {
+		lalr1_item_t item(g.to_lr0_item(scratch.item(k)));
+		scratch.for_each_column(scratch.lookaheads(scratch.item(k)), [&](size_t column) {
+			item.add_lookaheads(scratch.column_symbol(column));
+		});
+		new_I->add_items(item);
+	}
 
 #ifdef __DEBUG_OUTPUT__
 	std::cout << "LALR(1) Closure of start state:" << std::endl;
@@ -310,88 +226,21 @@ std::shared_ptr<parse::lalr1_item_set> parse::lalr_grammar::go_to(const lalr1_it
 
 std::shared_ptr<parse::lr0_item_set> parse::lalr_grammar::lr0_closure(const lr0_item_set& I) const {
 
-	std::shared_ptr<lr0_item_set> new_I = std::make_shared<lr0_item_set>(I);
-
-	bool changed = true;
-	do
-	{
-		changed = false;
-
-		// Copy current items to avoid modification during iteration
-		std::unordered_set<lr0_item_t, lr0_item_hasher> current_items = new_I->get_items(); 
-
-		for (const parse::lr0_item_t& i : current_items) {
-			parse::symbol_t next_sym = i.next_symbol();
-
-			if (next_sym.type == parse::symbol_type_t::NON_TERMINAL && !next_sym.name.empty()) {
-
-				// add new items for each production of next_sym
-				std::vector<std::shared_ptr<parse::production_t>> prods = get_productions_for(next_sym);
-				for (auto& prod : prods) {
-
-					int next_sym_prod_dot_pos = 0;
-					bool all_can_derive_epsilon = true;
-
-					while (next_sym_prod_dot_pos < prod->right.size() && all_can_derive_epsilon) {
-						parse::symbol_t current_sym = prod->right[next_sym_prod_dot_pos];
-
-						parse::lr0_item_t new_item(prod, next_sym_prod_dot_pos);
-
-						// Check if the new item already exists
-						const parse::lr0_item_t* found = new_I->find_item(new_item);
-						if (found == nullptr) {
-							new_I->add_items(new_item);
-							changed = true;
-						}
-
-
-						if (current_sym.type != parse::symbol_type_t::NON_TERMINAL) {
-							all_can_derive_epsilon = false;
-							break;
-						}
-
-						bool can_derive_epsilon = false;
-						if (first_sets.count(current_sym)) {
-							const auto& current_sym_first_sym = first_sets.at(current_sym);
-
-							// Deal with special case when the following non-terminals also can derive epsilon.
-							if (current_sym_first_sym.find(epsilon) != current_sym_first_sym.end()) {
-								can_derive_epsilon = true;
-
-								std::vector<std::shared_ptr<parse::production_t>> sub_prods = get_productions_for(current_sym);
-								for (const auto& sub_prod : sub_prods) {
-
-									parse::lr0_item_t sub_new_item(sub_prod, 0);
-
-									// Check if the new item already exists
-									const parse::lr0_item_t* found = new_I->find_item(sub_new_item);
-									if (found == nullptr) {
-										new_I->add_items(sub_new_item);
-										changed = true;
-									}
-
-								}
-
-							}
-						}
-
-						if (!can_derive_epsilon) {
-							all_can_derive_epsilon = false;
-							break;
-						}
-
-
-						next_sym_prod_dot_pos++;
-					}
-
-				}
-
-			}
-
-		}
+	// closed on the integer items of the frozen grammar, taking a snapshot if there is none
+	std::shared_ptr<const frozen_grammar> g = frozen ? frozen : std::make_shared<const frozen_grammar>(*this);
 
+	std::vector<frozen_grammar::item_index_t> kernel, items;
+	for (const auto& item : I.get_items()) {
+		frozen_grammar::item_index_t index = g->item_of(item);
+		if (index == frozen_grammar::INVALID_INDEX)
+			throw std::runtime_error("Closure of an item whose production is not in the grammar: " + item.to_string());
+		kernel.push_back(index);
+	}
+	g->lr0_closure(kernel, items);
 
-	} while (changed);
+	std::shared_ptr<lr0_item_set> new_I = std::make_shared<lr0_item_set>(I.id);
+	for (frozen_grammar::item_index_t item : items)
+		new_I->add_items(g->to_lr0_item(item));
 
 	return new_I;
 }
@@ -434,83 +283,307 @@ std::shared_ptr<parse::lr0_item_set> parse::lalr_grammar::lr0_go_to(const lr0_it
 	return lr0_closure(result);
 }
 
-std::unique_ptr<std::vector<std::shared_ptr<parse::lr0_item_set>>> parse::lalr_grammar::build_lr0_states()
+parse::frozen_grammar::frozen_grammar(const lalr_grammar& grammar)
 {
+	// terminals first, then non-terminals, each sorted by name so numbering is deterministic
+	std::vector<symbol_t> non_terminal_symbols;
+	for (const auto& [lhs, prods] : grammar.productions) {
+		non_terminal_symbols.push_back(lhs);
+		for (const auto& prod : prods) {
+			for (const auto& sym : prod->right) {
+				if (sym.type == symbol_type_t::TERMINAL)
+					symbols.push_back(sym);
+				else if (sym.type == symbol_type_t::NON_TERMINAL)
+					non_terminal_symbols.push_back(sym);
+			}
+		}
+	}
+	auto by_name = [](const symbol_t& a, const symbol_t& b) { return a.name < b.name; };
+	auto same_name = [](const symbol_t& a, const symbol_t& b) { return a.name == b.name; };
+	std::sort(symbols.begin(), symbols.end(), by_name);
+	symbols.erase(std::unique(symbols.begin(), symbols.end(), same_name), symbols.end());
+	std::sort(non_terminal_symbols.begin(), non_terminal_symbols.end(), by_name);
+	non_terminal_symbols.erase(std::unique(non_terminal_symbols.begin(), non_terminal_symbols.end(), same_name), non_terminal_symbols.end());
+
+	terminals = static_cast<uint32_t>(symbols.size());
+	symbols.insert(symbols.end(), non_terminal_symbols.begin(), non_terminal_symbols.end());
+	for (symbol_index_t i = 0; i < symbols.size(); i++)
+		symbol_indices.emplace(symbols[i], i);
+
+	// productions grouped by left-hand side, in their original order within a group
+	production_id_t last_id = 0;
+	for (symbol_index_t nt = terminals; nt < symbols.size(); nt++) {
+		left_begin.push_back(static_cast<uint32_t>(left.size()));
+
+		auto it = grammar.productions.find(symbols[nt]);
+		if (it == grammar.productions.end())
+			continue;
+
+		for (const auto& prod : it->second) {
+			uint32_t p = static_cast<uint32_t>(left.size());
+			left.push_back(nt);
+			rhs_offset.push_back(static_cast<uint32_t>(rhs.size()));
+			for (const auto& sym : prod->right) {
+				if (sym.type != symbol_type_t::EPSILON) {
+					rhs.push_back(symbol_indices.at(sym));
+					item_production.push_back(p);
+				}
+			}
+			rhs_length.push_back(static_cast<uint32_t>(rhs.size() - rhs_offset.back()));
+			rhs.push_back(END_OF_RHS);
+			item_production.push_back(p);
+			sources.push_back(prod);
 
-	auto lr0_states = std::make_unique<std::vector<std::shared_ptr<parse::lr0_item_set>>>();
-
-	// Create the augmented grammar
-	std::shared_ptr<parse::production_t> augmented_prod = std::make_shared<parse::production_t>(
-		parse::symbol_t(start_symbol.name + "'", parse::symbol_type_t::NON_TERMINAL),
-		std::vector<parse::symbol_t>{ start_symbol }
-	);
-	augmented_prod->id = AUGMENTED_GRAMMAR_PROD_ID;
-	productions.insert({ augmented_prod->left, { augmented_prod } });
+			first_id = p == 0 ? prod->id : std::min(first_id, prod->id);
+			last_id = p == 0 ? prod->id : std::max(last_id, prod->id);
+		}
+	}
+	left_begin.push_back(static_cast<uint32_t>(left.size()));
 
-	// Initialize the first item set with the augmented production (using lr0_item_t)
-	lr0_item_set start_set;
-	start_set.id = 0;
-	start_set.items.insert(parse::lr0_item_t(augmented_prod, 0)); // Correct item type
+	if (!sources.empty()) {
+		index_of_id.assign(static_cast<size_t>(last_id - first_id) + 1, INVALID_INDEX);
+		for (uint32_t p = 0; p < sources.size(); p++)
+			index_of_id[sources[p]->id - first_id] = p;
+	}
+}
 
-	// Compute closure for the start set
-	std::shared_ptr<lr0_item_set> closured_start_set = lr0_closure(start_set);
-	lr0_states->push_back(closured_start_set);
+void parse::frozen_grammar::lr0_closure(const std::vector<item_index_t>& kernel, std::vector<item_index_t>& items) const
+{
+	items.assign(kernel.begin(), kernel.end());
+
+	// each non-terminal after a dot adds its productions once; the new items are scanned in turn
+	std::vector<bool> expanded(symbols.size() - terminals, false);
+	for (size_t i = 0; i < items.size(); i++) {
+		symbol_index_t next = rhs[items[i]];
+		if (next == END_OF_RHS || is_terminal(next) || expanded[next - terminals])
+			continue;
+
+		expanded[next - terminals] = true;
+		for (uint32_t p = production_begin(next); p < production_end(next); p++)
+			items.push_back(rhs_offset[p]);
+	}
+}
 
-	// Use an index-based loop to process all states
-	for (size_t i = 0; i < lr0_states->size(); i++) {
-		std::shared_ptr<parse::lr0_item_set> current_set = (*lr0_states)[i];
+parse::lalr1_closure_arena::lalr1_closure_arena(const lalr_grammar& owner, std::shared_ptr<const frozen_grammar> frozen)
+	: grammar(std::move(frozen))
+{
+	const frozen_grammar& g = *grammar;
+
+	// terminals keep their index as column; the end marker and the sentinel follow if the grammar has no such terminals
+	for (frozen_grammar::symbol_index_t t = 0; t < g.terminal_count(); t++)
+		column_symbols.push_back(g.symbol(t));
+	auto column_for = [&](const symbol_t& sym) {
+		frozen_grammar::symbol_index_t s = g.index_of(sym);
+		if (s != frozen_grammar::INVALID_INDEX && g.is_terminal(s))
+			return static_cast<size_t>(s);
+		column_symbols.push_back(sym);
+		return column_symbols.size() - 1;
+	};
+	end_marker = column_for(owner.end_marker);
+	sentinel = column_for(owner.lookahead_sentinel);
+	columns = column_symbols.size();
+	words = (columns + 63) / 64;
+
+	size_t non_terminals = g.symbol_count() - g.terminal_count();
+	first_rows = allocate_rows(non_terminals);
+	nullable = allocate<bool>(non_terminals);
+	for (size_t n = 0; n < non_terminals; n++) {
+		auto it = owner.first_sets.find(g.symbol(static_cast<frozen_grammar::symbol_index_t>(g.terminal_count() + n)));
+		if (it == owner.first_sets.end())
+			continue;
+
+		for (const auto& sym : it->second) {
+			size_t column = column_of(sym);
+			if (sym.name == owner.epsilon.name)
+				nullable[n] = true;
+			else if (column < columns)
+				set(first_rows + n * words, column);
+		}
+	}
 
-		// Collect all symbols that can be transitioned on from current state
-		std::unordered_set<parse::symbol_t, parse::symbol_hasher> transition_symbols;
-		for (const auto& item : current_set->get_items()) {
+	// An item is in a closure and on its worklist at most once, so the item count bounds both
+	size_t items_total = g.item_count();
+	rows = allocate_rows(items_total);
+	first_after = allocate_rows(1);
+	in_closure = allocate<bool>(items_total);
+	queued = allocate<bool>(items_total);
+	items = allocate<item_index_t>(items_total);
+	worklist = allocate<item_index_t>(items_total);
+}
 
-			int dot_pos = item.dot_pos;
-			while (dot_pos < item.product->right.size()) {
-				parse::symbol_t next_sym = item.product->right[dot_pos];
-				if (next_sym.type == parse::symbol_type_t::TERMINAL) {
-					transition_symbols.insert(next_sym);
-					break;
-				}
+size_t parse::lalr1_closure_arena::column_of(const symbol_t& sym) const
+{
+	frozen_grammar::symbol_index_t s = grammar->index_of(sym);
+	if (s != frozen_grammar::INVALID_INDEX && grammar->is_terminal(s))
+		return s;
+	if (sym == column_symbols[end_marker])
+		return end_marker;
+	if (sym == column_symbols[sentinel])
+		return sentinel;
+	return columns;
+}
 
-				if (next_sym.type == parse::symbol_type_t::NON_TERMINAL) {
-					transition_symbols.insert(next_sym);
+void parse::lalr1_closure_arena::clear()
+{
+	// only the rows of the last closure were written
+	for (size_t k = 0; k < item_count; k++) {
+		std::fill_n(rows + items[k] * words, words, word_t(0));
+		in_closure[items[k]] = false;
+		queued[items[k]] = false;
+	}
+	item_count = 0;
+	pending = 0;
+}
 
-					if (!can_derive_epsilon(next_sym))
-						break;
-				}
+parse::lalr1_closure_arena::word_t* parse::lalr1_closure_arena::add_kernel(item_index_t item)
+{
+	if (!in_closure[item]) {
+		in_closure[item] = true;
+		items[item_count++] = item;
+	}
+	if (!queued[item]) {
+		queued[item] = true;
+		worklist[pending++] = item;
+	}
+	return rows + item * words;
+}
 
-				dot_pos++;
-				
+size_t parse::lalr1_closure_arena::close()
+{
+	const frozen_grammar& g = *grammar;
+	const size_t terminals = g.terminal_count();
+	size_t steps = 0;
+
+	// An item is taken off the worklist when it entered the closure or gained lookaheads, and
+	// hands FIRST(beta a) to [B -> . gamma] for each production of the B after its dot
+	while (pending > 0) {
+		item_index_t item = worklist[--pending];
+		queued[item] = false;
+		steps++;
+
+		frozen_grammar::symbol_index_t B = g.next_symbol(item);
+		if (B == frozen_grammar::END_OF_RHS || g.is_terminal(B))
+			continue;
+
+		std::fill_n(first_after, words, word_t(0));
+		bool rest_nullable = true;
+		for (item_index_t beta = item + 1; rest_nullable && g.next_symbol(beta) != frozen_grammar::END_OF_RHS; beta++) {
+			frozen_grammar::symbol_index_t sym = g.next_symbol(beta);
+			if (g.is_terminal(sym)) {
+				set(first_after, sym);
+				rest_nullable = false;
+			}
+			else {
+				merge(first_after, first_rows + (sym - terminals) * words);
+				rest_nullable = nullable[sym - terminals];
 			}
 		}
-
-		// For each symbol, compute GOTO and add new states
-		for (const auto& symbol : transition_symbols) {
-			std::shared_ptr<lr0_item_set> goto_set = lr0_go_to(*current_set, symbol);
-			if (goto_set == nullptr || goto_set->get_items().empty()) {
-				continue; // Skip empty GOTO sets
+		if (rest_nullable)
+			merge(first_after, rows + item * words);
+
+		// Only [B -> . gamma] is added: a nullable symbol is reduced to through its epsilon
+		// production, never skipped, or the parser would pop symbols that were never pushed.
+		for (uint32_t p = g.production_begin(B); p < g.production_end(B); p++) {
+			item_index_t added = g.first_item(p);
+			bool entered = !in_closure[added];
+			if (entered) {
+				in_closure[added] = true;
+				items[item_count++] = added;
 			}
-
-			// Check if the GOTO set already exists in lr0_states
-			bool exists = false;
-			item_set_id_t existing_id = 0;
-			for (const auto& state : *lr0_states) {
-				if (*state == *goto_set) {
-					exists = true;
-					existing_id = state->id;
-					break;
-				}
+			if ((merge(rows + added * words, first_after) || entered) && !queued[added]) {
+				queued[added] = true;
+				worklist[pending++] = added;
 			}
+		}
+	}
 
-			if (!exists) {
-				// Add new state
-				goto_set->id = lr0_states->size();
-				lr0_states->push_back(goto_set);
-				existing_id = goto_set->id;
-			}
+	return steps;
+}
+
+parse::lalr_grammar::arena_scope::arena_scope(lalr_grammar& grammar) : grammar(grammar)
+{
+	grammar.arena = std::make_shared<lalr1_closure_arena>(grammar, grammar.frozen);
+}
+
+parse::lalr_grammar::arena_scope::~arena_scope()
+{
+	grammar.stats.arena_bytes = grammar.arena->bytes();
+	grammar.arena.reset();
+}
+
+parse::lalr1_closure_arena& parse::lalr_grammar::closure_arena(std::unique_ptr<lalr1_closure_arena>& local)
+{
+	if (arena)
+		return *arena;
+
+	local = std::make_unique<lalr1_closure_arena>(*this, frozen ? frozen : std::make_shared<const frozen_grammar>(*this));
+	return *local;
+}
+
+std::unique_ptr<std::vector<std::shared_ptr<parse::lr0_item_set>>> parse::lalr_grammar::build_lr0_states()
+{
+	build_stats_t::scoped_phase phase(stats, "build_lr0_states");
+
+	auto lr0_states = std::make_unique<std::vector<std::shared_ptr<parse::lr0_item_set>>>();
+
+	// Create the augmented grammar
+	std::shared_ptr<parse::production_t> augmented_prod = std::make_shared<parse::production_t>(
+		parse::symbol_t(start_symbol.name + "'", parse::symbol_type_t::NON_TERMINAL),
+		std::vector<parse::symbol_t>{ start_symbol },
+		AUGMENTED_GRAMMAR_PROD_ID
+	);
+	productions.insert({ augmented_prod->left, { augmented_prod } });
+
+	// The automaton is built on integer items of a frozen snapshot of the grammar; a state
+	// is identified by its sorted kernel. Items are converted to lr0_item_t only for the
+	// item sets handed on to the LALR(1) construction.
+	frozen = std::make_shared<const frozen_grammar>(*this);
+	const frozen_grammar& g = *frozen;
+	using item_index_t = frozen_grammar::item_index_t;
+	using symbol_index_t = frozen_grammar::symbol_index_t;
+
+	std::vector<std::vector<item_index_t>> kernels;
+	std::map<std::vector<item_index_t>, item_set_id_t> state_of_kernel;
+	kernels.push_back({ g.first_item(g.production_begin(g.index_of(augmented_prod->left))) });
+	state_of_kernel.emplace(kernels[0], 0);
+
+	std::vector<item_index_t> items;                                      // Closure of the current state
+	std::vector<std::vector<item_index_t>> successors(g.symbol_count());  // Kernel of the GOTO on each symbol
+	std::vector<symbol_index_t> transition_symbols;                       // Symbols with a non-empty GOTO
+
+	for (size_t i = 0; i < kernels.size(); i++) {
+		g.lr0_closure(kernels[i], items);
+		stats.lr0_closures++;
+		stats.closure_items += items.size();
+
+		std::shared_ptr<lr0_item_set> state = std::make_shared<lr0_item_set>(static_cast<int>(i));
+		for (item_index_t item : items)
+			state->add_items(g.to_lr0_item(item));
+		lr0_states->push_back(state);
+
+		// move the dot over the symbol after it, collecting the kernels of the successors
+		transition_symbols.clear();
+		for (item_index_t item : items) {
+			symbol_index_t next = g.next_symbol(item);
+			if (next == frozen_grammar::END_OF_RHS)
+				continue;
+			if (successors[next].empty())
+				transition_symbols.push_back(next);
+			successors[next].push_back(item + 1);
+		}
+		std::sort(transition_symbols.begin(), transition_symbols.end());
+
+		for (symbol_index_t X : transition_symbols) {
+			std::vector<item_index_t>& kernel = successors[X];
+			std::sort(kernel.begin(), kernel.end());
+
+			auto found = state_of_kernel.emplace(kernel, static_cast<item_set_id_t>(kernels.size()));
+			if (found.second)
+				kernels.push_back(kernel);
 
 			// Record the GOTO transition in the cache table
-			goto_table[{current_set->id, symbol}] = existing_id;
+			goto_table[{ static_cast<item_set_id_t>(i), g.symbol(X) }] = found.first->second;
+			kernel.clear();
 		}
 	}
 
@@ -561,7 +634,7 @@ std::unique_ptr<std::vector<std::shared_ptr<parse::lr0_item_set>>> parse::lalr_g
 
 	// Debug output: print states and GOTO table
 
-//#ifdef __DEBUG_OUTPUT__
+#ifdef __DEBUG_OUTPUT__
 	std::cout << "Total LR(0) states: " << lr0_states->size() << std::endl;
 	for (const auto& state : *lr0_states) {
 		std::cout << *state << std::endl;
@@ -574,7 +647,7 @@ std::unique_ptr<std::vector<std::shared_ptr<parse::lr0_item_set>>> parse::lalr_g
 			<< " on symbol '" << entry.first.second.name << "'" << std::endl;
 	}
 
-//#endif
+#endif
 
 	return std::move(lr0_states);
 }
@@ -585,6 +658,7 @@ std::unique_ptr<std::vector<std::shared_ptr<parse::lr0_item_set>>> parse::lalr_g
 	except for the start item in state 0, which is initialized with the end marker ($).
 */
 void parse::lalr_grammar::initialize_lalr1_states() {
+	build_stats_t::scoped_phase phase(stats, "initialize_lalr1_states");
 
 	auto lr0_states = build_lr0_states();
 
@@ -614,240 +688,1156 @@ void parse::lalr_grammar::initialize_lalr1_states() {
 		}
 	}
 
+	// The LR(0) states are dropped here, so this is when most item sets are alive
+	size_t lr0_bytes = 0;
+	for (const auto& state : *lr0_states)
+		lr0_bytes += state->memory_size();
+	stats.note_bytes(lr0_bytes + lalr1_states_memory_size());
 }
 
 
-// Parses the input and constructs LALR(1) parsing tables
-void parse::lalr_grammar::determine_lookaheads(
-	const item_set_id_t I_id,
-	const symbol_t X,
-	std::unordered_map<std::pair<item_set_id_t, item_id_t>, std::vector<std::pair<item_set_id_t, item_id_t>>, pair_items_state_item_id_hasher>& propagation_graph,
-	std::unordered_map<std::pair<item_set_id_t, item_id_t>, std::unordered_set<parse::symbol_t, parse::symbol_hasher>, pair_items_state_item_id_hasher>& spontaneous_lookaheads)
+// Determines the lookahead links of a state. The closure of each kernel item with the sentinel
+// lookahead is computed once; every item in it with a symbol after the dot passes its lookaheads on
+// to the item with the dot moved over that symbol, in the GOTO state on the symbol. The sentinel
+// stands for the lookaheads of the kernel item, which propagate; the others are spontaneous, and
+// those a successor item gets from several kernel items are merged into one link.
+std::shared_ptr<const parse::state_lookahead_links_t> parse::lalr_grammar::determine_lookaheads(const item_set_id_t I_id)
 {
+	auto links = std::make_shared<state_lookahead_links_t>();
 
-	// Retrieve LALR(1) state corresponding to I_id
-	std::shared_ptr<lalr1_item_set> I = lalr1_states[I_id];
+	std::unique_ptr<lalr1_closure_arena> local;
+	lalr1_closure_arena& scratch = closure_arena(local);
+	const frozen_grammar& g = scratch.frozen();
+	links->grammar = scratch.snapshot();
+
+	// Spontaneous link of each successor item given spontaneous lookaheads, which are merged into its row
+	const size_t words = scratch.row_words();
+	links->words = words;
+	std::unordered_map<frozen_grammar::item_index_t, size_t> target_index;
+	std::vector<lalr1_closure_arena::word_t> sentinel_mask(words, 0);
+	lalr1_closure_arena::set(sentinel_mask.data(), scratch.sentinel_column());
 
 	// Process each kernel item in the state
-	for (const auto& kernel : I->get_items()) {
-		// Create a copy of kernel item with sentinel lookahead
-		lalr1_item_t kernel_with_sentinel = lalr1_item_t(kernel);
-		kernel_with_sentinel.add_lookaheads(lookahead_sentinel);
-
-		// Create item set containing the kernel with sentinel
-		lalr1_item_set original_item_set;
-		original_item_set.add_items(kernel_with_sentinel);
-
-		// Compute closure of the item set (TODO: Add caching)
-		std::shared_ptr<lalr1_item_set> J = closure(original_item_set);
-
-		// Process each item in the closure
-		for (const auto& B : J->get_items()) {
-			// Skip items where next symbol isn't X
-			if (B.next_symbol() != X)
+	for (const auto& kernel : lalr1_states[I_id]->get_items()) {
+		// Close the kernel item with the sentinel as its only lookahead
+		scratch.clear();
+		lalr1_closure_arena::set(scratch.add_kernel(g.item_of(kernel)), scratch.sentinel_column());
+		stats.closure_calls++;
+		stats.closure_steps += scratch.close();
+
+		// Process each item in the closure that has a symbol X after the dot
+		for (size_t k = 0; k < scratch.size(); k++) {
+			frozen_grammar::item_index_t B = scratch.item(k);
+			frozen_grammar::symbol_index_t X = g.next_symbol(B);
+			if (X == frozen_grammar::END_OF_RHS)
 				continue;
 
-			// Process each lookahead symbol in item B
-			for (const auto& la : B.lookaheads) {
-				if (la != lookahead_sentinel) {
-					// Handle spontaneous lookahead propagation
-					auto closured_goto_B_set = go_to(*J, X);
-					auto target_item_id = goto_table[{I_id, X}];
-
-					// Find corresponding item in GOTO set and record spontaneous lookahead
-					for (const auto& goto_B : closured_goto_B_set->get_items()) {
-						if (goto_B.product->id == B.product->id && goto_B.dot_pos == B.dot_pos + 1)
-							spontaneous_lookaheads[{target_item_id, goto_B.id}].insert(la);
-					}
-				}
+			const lalr1_closure_arena::word_t* row = scratch.lookaheads(B);
+			if (lalr1_closure_arena::test(row, scratch.sentinel_column()))
+				links->propagation.push_back({ kernel.id, X, g.item_id(B + 1) });
 
-				if (la == lookahead_sentinel) {
-					// Handle lookahead propagation through sentinel
-					auto closured_goto_B_set = go_to(*J, X);
-					auto target_item_id = goto_table[{I_id, X}];
+			bool spontaneous = false;
+			for (size_t w = 0; w < words && !spontaneous; w++)
+				spontaneous = (row[w] & ~sentinel_mask[w]) != 0;
+			if (!spontaneous)
+				continue;
 
-					// Record propagation relationship in graph
-					for (const auto& goto_B : closured_goto_B_set->get_items()) {
-						if (goto_B.product->id == B.product->id && goto_B.dot_pos == B.dot_pos + 1)
-							propagation_graph[{I_id, kernel.id}].push_back({ target_item_id, goto_B.id });
-					}
-				}
+			auto [it, added] = target_index.try_emplace(B + 1, links->spontaneous.size());
+			if (added) {
+				links->spontaneous.push_back({ X, g.item_id(B + 1) });
+				links->lookaheads.resize(links->lookaheads.size() + words, 0);
 			}
+			lalr1_closure_arena::word_t* merged = links->lookaheads.data() + it->second * words;
+			for (size_t w = 0; w < words; w++)
+				merged[w] |= row[w] & ~sentinel_mask[w];
 		}
 	}
+
+	if (keep_lookahead_links) {
+		links->propagation.shrink_to_fit();
+		links->spontaneous.shrink_to_fit();
+		links->lookaheads.shrink_to_fit();
+	}
+	return links;
 }
 
 // Computes and propagates lookaheads for all LALR(1) states
 void parse::lalr_grammar::set_lalr1_items_lookaheads()
 {
+	build_stats_t::scoped_phase phase(stats, "set_lalr1_items_lookaheads");
+	size_t kernel_bytes = lalr1_states_memory_size();
+	std::unique_ptr<lalr1_closure_arena> local;
+	lalr1_closure_arena& scratch = closure_arena(local);
+	const frozen_grammar& g = scratch.frozen();
+
+	// Number the kernel items of all states, state by state in the order of their items; the
+	// number of an item is that of the first item of its state plus its position there
+	std::vector<size_t> first_slot(lalr1_states.size() + 1, 0);
+	for (size_t i = 0; i < lalr1_states.size(); i++)
+		first_slot[i + 1] = first_slot[i] + lalr1_states[i]->items.size();
+	const size_t slot_count = first_slot.back();
+
+	auto find_slot = [&](item_set_id_t state, item_id_t item) {
+		size_t index = lalr1_states[state]->index_of(item);
+		return index < lalr1_states[state]->items.size() ? first_slot[state] + index : slot_count;
+	};
+
+	// Determine the links of the states that have none yet and resolve them to the states of this
+	// automaton right away: spontaneous lookaheads seed the kernel items, propagation links become
+	// edges between them. The lookaheads of a slot are a row of the arena. Links are dropped once
+	// resolved unless keep_lookahead_links is set.
+	lalr1_closure_arena::word_t* lookahead_rows = scratch.allocate_rows(slot_count);
+	auto lookaheads = [&](size_t slot) {
+		return lookahead_rows + slot * scratch.row_words();
+	};
+	std::vector<std::vector<size_t>> propagates_to(slot_count);
+
+	// Adds the lookahead row of a link to the row of a slot; rows of reused links made for another
+	// grammar are translated column by column
+	const frozen_grammar* mapped_grammar = &g;
+	std::vector<size_t> column_map;
+	auto add_lookaheads = [&](size_t slot, const state_lookahead_links_t& links, size_t k) {
+		const lalr1_closure_arena::word_t* row = links.lookahead_row(k);
+		if (links.grammar.get() == &g) {
+			scratch.merge(lookaheads(slot), row);
+			return;
+		}
 
+		const frozen_grammar& from = *links.grammar;
+		if (&from != mapped_grammar) {
+			column_map.assign(from.terminal_count() + 1, scratch.column_count());
+			for (frozen_grammar::symbol_index_t t = 0; t < from.terminal_count(); t++)
+				column_map[t] = scratch.column_of(from.symbol(t));
+			column_map[from.terminal_count()] = scratch.end_marker_column();
+			mapped_grammar = &from;
+		}
+		for (size_t column = 0; column < column_map.size() && column < links.words * 64; column++) {
+			if (lalr1_closure_arena::test(row, column) && column_map[column] < scratch.column_count())
+				lalr1_closure_arena::set(lookaheads(slot), column_map[column]);
+		}
+	};
 
-#ifdef __DEBUG__
-	//std::cout << "LALR(1) States Built. Total States: " << lalr1_states.size() << std::endl;
-	//std::cout << lalr1_states_to_string() << std::endl;
-#endif
-
-	// Data structures for tracking lookahead propagation
-	std::unordered_map<std::pair<item_set_id_t, item_id_t>, std::vector<std::pair<item_set_id_t, item_id_t>>, pair_items_state_item_id_hasher> propagation_graph;
-	std::unordered_map<std::pair<item_set_id_t, item_id_t>, std::unordered_set<parse::symbol_t, parse::symbol_hasher>, pair_items_state_item_id_hasher> spontaneous_lookaheads;
+	lookahead_links.resize(lalr1_states.size());
+	size_t link_bytes = 0, largest_links = 0;
+	{
+		build_stats_t::scoped_phase determine(stats, "determine_lookaheads");
+		for (size_t i = 0; i < lalr1_states.size(); i++) {
+			const item_set_id_t state = static_cast<item_set_id_t>(i);
+			std::shared_ptr<const state_lookahead_links_t> links = std::move(lookahead_links[i]);
+			if (links) {
+				stats.links_reused++;
+			}
+			else {
+				links = determine_lookaheads(state);
+				stats.links_determined++;
+			}
+			const frozen_grammar& from = *links->grammar;
+
+			for (const auto& link : links->propagation) {
+				size_t source = find_slot(state, link.from);
+				size_t target = find_slot(goto_table.at({ state, from.symbol(link.symbol) }), link.to);
+				if (source < slot_count && target < slot_count) {
+					propagates_to[source].push_back(target);
+					stats.propagation_edges++;
+				}
+			}
 
-	// Process all states for both terminal and non-terminal symbols
-	for (item_set_id_t i = 0; i < lalr1_states.size(); i++) {
-		for (const auto& X : terminals)
-			determine_lookaheads(i, X, propagation_graph, spontaneous_lookaheads);
+			for (size_t k = 0; k < links->spontaneous.size(); k++) {
+				const auto& link = links->spontaneous[k];
+				size_t target = find_slot(goto_table.at({ state, from.symbol(link.symbol) }), link.to);
+				if (target < slot_count)
+					add_lookaheads(target, *links, k);
+			}
 
-		for (const auto& X : non_terminals)
-			determine_lookaheads(i, X, propagation_graph, spontaneous_lookaheads);
+			// Links not kept live only while their state is resolved
+			if (keep_lookahead_links) {
+				link_bytes += links->memory_size();
+				lookahead_links[i] = std::move(links);
+			}
+			else {
+				largest_links = std::max(largest_links, links->memory_size());
+			}
+		}
+		if (!keep_lookahead_links)
+			lookahead_links.clear();
 	}
 
+	size_t edge_bytes = vector_bytes(propagates_to);
+	for (const auto& edges : propagates_to)
+		edge_bytes += vector_bytes(edges);
+	stats.link_bytes = link_bytes + largest_links + edge_bytes;
+	stats.note_bytes(kernel_bytes + scratch.bytes() + stats.link_bytes);
 
-	// Apply spontaneous lookaheads to items
-	for (const auto& spon : spontaneous_lookaheads) {
-		auto [I_id, i_id] = spon.first;
-		lalr1_states[I_id]->add_lookaheads_for_item(i_id, spon.second);
-	}
+	build_stats_t::scoped_phase propagate(stats, "propagate_lookaheads");
 
-	item_id_t start_item_id = 0;
 	for (const auto& item : lalr1_states[0]->get_items()) {
 		if (item.product->id == AUGMENTED_GRAMMAR_PROD_ID) {
-			start_item_id = item.id;
+			lalr1_closure_arena::set(lookaheads(find_slot(0, item.id)), scratch.end_marker_column());
 			break;
 		}
 	}
 
-	lalr1_states[0]->add_lookaheads_for_item(start_item_id, { end_marker });
-
-
-
-#ifdef __DEBUG__
-	//std::cout << "LALR(1) States Built. Total States: " << lalr1_states.size() << std::endl;
-	//std::cout << lalr1_states_to_string() << std::endl;
-#endif
-
-
+	// Propagate lookaheads along the edges until no item gains any
+	std::vector<size_t> worklist;
+	std::vector<bool> queued(slot_count, false);
+	for (size_t s = 0; s < slot_count; s++) {
+		const lalr1_closure_arena::word_t* row = lookaheads(s);
+		if (std::any_of(row, row + scratch.row_words(), [](lalr1_closure_arena::word_t w) { return w != 0; })) {
+			worklist.push_back(s);
+			queued[s] = true;
+		}
+	}
 
-	// Propagate lookaheads until no changes occur
-	bool changed = true;
-	do {
-		changed = false;
-		for (item_set_id_t I_id = 0; I_id < lalr1_states.size(); I_id++) {
-			for (const auto& kernel : lalr1_states[I_id]->get_items()) {
-				// Check if current item has propagation entries
-				auto prop_it = propagation_graph.find({ I_id, kernel.id });
-				if (prop_it != propagation_graph.end()) {
-					for (const auto& target_pair : prop_it->second) {
-						item_set_id_t target_set_id = target_pair.first;
-						item_id_t target_item_id = target_pair.second;
-
-						const auto target_item = lalr1_states[target_set_id]->find_item_by_id(target_item_id);
-						if (!target_item) continue;
-
-						// Collect lookaheads that need to be added
-						std::unordered_set<parse::symbol_t, parse::symbol_hasher> to_add;
-						for (const auto& la : kernel.lookaheads) {
-							if (target_item->lookaheads.find(la) == target_item->lookaheads.end()) {
-								to_add.insert(la);
-							}
-						}
+	while (!worklist.empty()) {
+		size_t from = worklist.back();
+		worklist.pop_back();
+		queued[from] = false;
+		stats.propagation_steps++;
 
-						// Add new lookaheads and mark change if necessary
-						if (!to_add.empty()) {
-							lalr1_states[target_set_id]->add_lookaheads_for_item(target_item_id, to_add);
-							changed = true;
-						}
-					}
-				}
+		for (size_t to : propagates_to[from]) {
+			if (scratch.merge(lookaheads(to), lookaheads(from)) && !queued[to]) {
+				worklist.push_back(to);
+				queued[to] = true;
 			}
 		}
-	} while (changed);
+	}
 
-#ifdef __DEBUG__
+	// Write the lookaheads into the items in place (items are visited in slot order)
+	size_t slot = 0;
+	stats.lookaheads = 0;
+	for (auto& state : lalr1_states) {
+		for (auto& item : state->get_items()) {
+			scratch.for_each_column(lookaheads(slot++), [&](size_t column) {
+				item.add_lookaheads(scratch.column_symbol(column));
+			});
+			stats.lookaheads += item.lookaheads.size();
+		}
+	}
+
+	stats.states = lalr1_states.size();
+	stats.kernel_items = slot_count;
+	stats.note_bytes(lalr1_states_memory_size() + scratch.bytes() + stats.link_bytes);
+
+#ifdef __DEBUG_OUTPUT__
 	std::cout << "LALR(1) States Built. Total States: " << lalr1_states.size() << std::endl;
 	std::cout << lalr1_states_to_string() << std::endl;
 #endif
 
 }
 
+void parse::lalr_grammar::report_conflict(const std::string& kind, item_set_id_t state, const symbol_t& symbol, const std::string& message)
+{
+	if (collect_conflicts) {
+		conflicts.push_back({ kind, state, symbol, message });
+		return;
+	}
+	std::cerr << message << std::endl;
+	throw std::runtime_error(kind + " conflict detected");
+}
+
 // Constructs the ACTION table from LALR(1) states
-void parse::lalr_grammar::build_action_table()
+// Shift actions of a state are entered before its reduce actions, so every shift/reduce conflict is
+// seen by the reduce and resolved the yacc way: the higher precedence of the production and of the
+// lookahead terminal wins, ties follow the associativity (left reduces, right shifts, nonassoc makes
+// the pair an error). Conflicts involving undeclared precedence, and reduce/reduce conflicts, throw,
+// or are recorded in conflicts with the first action kept if collect_conflicts is set.
+void parse::lalr_grammar::build_action_table(const std::vector<bool>& prebuilt_rows)
 {
+	build_stats_t::scoped_phase phase(stats, "build_action_table");
+	conflicts.clear();
+
+	std::unique_ptr<lalr1_closure_arena> local;
+	lalr1_closure_arena& scratch = closure_arena(local);
+	const frozen_grammar& g = scratch.frozen();
+
+	// Reduces of the current state whose shift/reduce conflict became a nonassoc ERROR entry;
+	// later reduces on the same lookahead are still checked against them
+	std::unordered_map<symbol_t, parser_action_t, symbol_hasher> nonassoc_reduces;
+
 	// Process each state in the LALR(1) state machine
 	for (item_set_id_t i = 0; i < lalr1_states.size(); i++) {
-		auto& state = lalr1_states[i];
+		if (static_cast<size_t>(i) < prebuilt_rows.size() && prebuilt_rows[i])
+			continue;
+
 		// Compute closure of the state
-		auto J = closure(*state);
-
-		// Process each item in the closure
-		for (auto& item : J->get_items()) {
-			auto& prod = item.product;
-
-			// Handle reduce actions (dot at end of production)
-			if (item.dot_pos >= prod->right.size() || (prod->right.size() == 1 && prod->right[0] == epsilon && item.dot_pos == 0)) {
-				for (auto& la : item.lookaheads) {
-					// Check for conflicts with existing actions
-					if (action_table[i].count(la)) {
-						auto& existing_action = action_table[i][la];
-						if (existing_action.type == parser_action_type_t::SHIFT) {
-							std::cerr << "Shift-Reduce conflict at state " << i
-								<< " on symbol " << la.name
-								<< " between shift to " << existing_action.value
-								<< " and reduce by production " << get_production_by_id(prod->id)->to_string() << std::endl;
-							throw std::runtime_error("Shift-Reduce conflict detected");
-						}
-						else if (existing_action.type == parser_action_type_t::REDUCE) {
-							std::cerr << "Reduce-Reduce conflict at state " << i
-								<< " on symbol " << la.name
-								<< " between production " << existing_action.value
-								<< " and production " << get_production_by_id(prod->id)->to_string() << std::endl;
-							throw std::runtime_error("Reduce-Reduce conflict detected");
-						}
-					}
+		scratch.clear();
+		for (const auto& item : lalr1_states[i]->get_items()) {
+			lalr1_closure_arena::word_t* row = scratch.add_kernel(g.item_of(item));
+			for (const auto& la : item.lookaheads) {
+				size_t column = scratch.column_of(la);
+				if (column < scratch.column_count())
+					lalr1_closure_arena::set(row, column);
+			}
+		}
+		stats.closure_calls++;
+		stats.closure_steps += scratch.close();
+		auto& row = action_table[i];
+		nonassoc_reduces.clear();
+
+		// Handle shift actions (dot before terminal symbol)
+		for (size_t k = 0; k < scratch.size(); k++) {
+			frozen_grammar::symbol_index_t next = g.next_symbol(scratch.item(k));
+			if (next == frozen_grammar::END_OF_RHS || !g.is_terminal(next))
+				continue;
+			const symbol_t& next_symbol = g.symbol(next);
 
-					// Handle accept action (start symbol with end marker)
-					if (prod->left == start_symbol && la == end_marker)
-						action_table[i][la] = { parser_action_type_t::ACCEPT, AUGMENTED_GRAMMAR_PROD_ID };
-					else
-						action_table[i][la] = { parser_action_type_t::REDUCE, prod->id };
+			// Check if GOTO entry exists for this symbol
+			auto goto_it = goto_table.find(std::make_pair(i, next_symbol));
+			if (goto_it == goto_table.end())
+				continue;
+
+			parser_action_t shift = { parser_action_type_t::SHIFT, static_cast<parser_action_value_t>(goto_it->second) };
+			auto existing = row.find(next_symbol);
+			if (existing != row.end() && existing->second != shift) {
+				std::ostringstream message;
+				message << "Shift-Shift conflict at state " << i
+					<< " on symbol " << next_symbol.name
+					<< " between " << existing->second.to_string()
+					<< " and shift to " << goto_it->second;
+				report_conflict("Shift-Shift", i, next_symbol, message.str());
+				continue;
+			}
+			row[next_symbol] = shift;
+		}
+
+		// Handle reduce actions (dot at end of production)
+		for (size_t k = 0; k < scratch.size(); k++) {
+			frozen_grammar::item_index_t item = scratch.item(k);
+			if (g.next_symbol(item) != frozen_grammar::END_OF_RHS)
+				continue;
+
+			const auto& prod = g.production(g.production_of(item));
+			scratch.for_each_column(scratch.lookaheads(item), [&](size_t column) {
+				const symbol_t& la = scratch.column_symbol(column);
+				// Handle accept action (start symbol with end marker)
+				parser_action_t reduce = (prod->left == start_symbol && la == end_marker)
+					? parser_action_t{ parser_action_type_t::ACCEPT, AUGMENTED_GRAMMAR_PROD_ID }
+					: parser_action_t{ parser_action_type_t::REDUCE, prod->id };
+
+				auto existing = row.find(la);
+				if (existing == row.end()) {
+					row[la] = reduce;
+					return;
 				}
+
+				auto& existing_action = existing->second;
+				if (existing_action == reduce)
+					return;
+
+				const parser_action_t* other_reduce = &existing_action;
+				if (existing_action.type == parser_action_type_t::ERROR) {
+					auto resolved = nonassoc_reduces.find(la);
+					if (resolved == nonassoc_reduces.end() || resolved->second == reduce)
+						return;
+					other_reduce = &resolved->second;
+				}
+
+				if (other_reduce->type != parser_action_type_t::SHIFT) {
+					std::ostringstream message;
+					message << "Reduce-Reduce conflict at state " << i
+						<< " on symbol " << la.name
+						<< " between production " << other_reduce->value
+						<< " and production " << prod->to_string();
+					report_conflict("Reduce-Reduce", i, la, message.str());
+					return;
+				}
+
+				// Resolve the shift/reduce conflict by precedence
+				precedence_t token_prec = precedence_of(la);
+				precedence_t prod_prec = precedence_of(*prod);
+				if (token_prec.level == 0 || prod_prec.level == 0) {
+					std::ostringstream message;
+					message << "Shift-Reduce conflict at state " << i
+						<< " on symbol " << la.name
+						<< " between shift to " << existing_action.value
+						<< " and reduce by production " << prod->to_string();
+					report_conflict("Shift-Reduce", i, la, message.str());
+					return;
+				}
+
+				if (prod_prec.level > token_prec.level ||
+					(prod_prec.level == token_prec.level && prod_prec.assoc == associativity_t::LEFT))
+					existing_action = reduce;
+				else if (prod_prec.level == token_prec.level && prod_prec.assoc == associativity_t::NONASSOC) {
+					existing_action = { parser_action_type_t::ERROR, -1 };
+					nonassoc_reduces[la] = reduce;
+				}
+			});
+		}
+	}
+
+	stats.action_entries = 0;
+	for (const auto& [state, row] : action_table)
+		stats.action_entries += row.size();
+	stats.goto_entries = goto_table.size();
+	stats.note_bytes(lalr1_states_memory_size() + scratch.bytes() + lookahead_links_memory_size() + tables_memory_size());
+}
+
+
+void parse::lalr_grammar::build(const lalr_grammar& previous)
+{
+	if (previous.lalr1_states.empty() || previous.action_table.size() != previous.lalr1_states.size() ||
+		previous.lookahead_links.size() != previous.lalr1_states.size() || !previous.conflicts.empty() ||
+		previous.start_symbol != start_symbol) {
+		build();
+		return;
+	}
+	stats = build_stats_t();
+	build_stats_t::scoped_phase phase(stats, "build");
+	lookahead_links.clear();
+
+	// Match the productions against those of previous; matched ones take over its IDs
+	using production_key_t = std::tuple<symbol_t, std::vector<symbol_t>, std::string>;
+	auto key_of = [](const production_t& prod) {
+		return production_key_t(prod.left, prod.right, prod.precedence_symbol.name);
+	};
+
+	std::map<production_key_t, std::vector<std::shared_ptr<production_t>>> previous_productions;
+	for (const auto& [left, prods] : previous.productions) {
+		for (const auto& prod : prods) {
+			if (prod->id != AUGMENTED_GRAMMAR_PROD_ID)
+				previous_productions[key_of(*prod)].push_back(prod);
+		}
+	}
+
+	std::unordered_set<symbol_t, symbol_hasher> changed;  // Non-terminals whose productions changed
+	next_production_id = previous.next_production_id;
+	for (const auto& [left, prods] : productions) {
+		for (const auto& prod : prods) {
+			auto it = previous_productions.find(key_of(*prod));
+			if (it != previous_productions.end() && !it->second.empty()) {
+				prod->id = it->second.back()->id;
+				it->second.pop_back();
 			}
-			// Handle shift actions (dot before terminal symbol)
 			else {
-				const auto& next_symbol = prod->right[item.dot_pos];
-
-				if (next_symbol.type == symbol_type_t::TERMINAL) {
-					if (next_symbol != epsilon) {
-						// Check if GOTO entry exists for this symbol
-						auto goto_key = std::make_pair(i, next_symbol);
-						if (goto_table.find(goto_key) != goto_table.end()) {
-							auto next_state = goto_table[{i, next_symbol}];
-
-							// Check for shift-shift conflicts
-							if (action_table[i].count(next_symbol)) {
-								auto& existing_action = action_table[i][next_symbol];
-								if (!(existing_action.type == parser_action_type_t::SHIFT && existing_action.value == next_state)) {
-
-									std::cerr << (existing_action.type != parser_action_type_t::SHIFT ? "Reduce" : "Shift")
-										<< "-Shift conflict at state " << i
-										<< " on symbol " << next_symbol.name
-										<< " between " + existing_action.to_string() + "{" + get_production_by_id(existing_action.value)->to_string() + "}"
-										<< " and shift to " << next_state << std::endl;
-									throw std::runtime_error("Shift-Shift conflict detected");
-								}
-							}
-							else {
-								// Add shift action to table
-								action_table[i][next_symbol] = { parser_action_type_t::SHIFT, static_cast<parser_action_value_t>(next_state) };
-							}
-						}
-					}
-					else {
-						// Handle epsilon productions by adding reduce actions
-						for (const auto& la : item.lookaheads) {
-							action_table[i][la] = { parser_action_type_t::REDUCE, prod->id };
-						}
-					}
+				prod->id = next_production_id++;
+				changed.insert(left);
+			}
+		}
+	}
+	for (const auto& [key, prods] : previous_productions) {
+		if (!prods.empty())
+			changed.insert(std::get<0>(key));
+	}
+	frozen.reset();
+
+	// FIRST sets: keep those of the non-terminals deriving no changed one
+	std::unordered_map<symbol_t, std::vector<symbol_t>, symbol_hasher> used_by;
+	for (const auto& [left, prods] : productions) {
+		for (const auto& prod : prods) {
+			for (const auto& sym : prod->right) {
+				if (sym.type == symbol_type_t::NON_TERMINAL)
+					used_by[sym].push_back(left);
+			}
+		}
+	}
+
+	std::unordered_set<symbol_t, symbol_hasher> affected(changed.begin(), changed.end());
+	std::vector<symbol_t> worklist(changed.begin(), changed.end());
+	while (!worklist.empty()) {
+		symbol_t sym = worklist.back();
+		worklist.pop_back();
+		for (const auto& user : used_by[sym]) {
+			if (affected.insert(user).second)
+				worklist.push_back(user);
+		}
+	}
+
+	first_sets.clear();
+	for (const auto& [sym, first] : previous.first_sets) {
+		if (!affected.count(sym))
+			first_sets.insert({ sym, first });
+	}
+	comp_first_sets();
+
+	std::unordered_set<symbol_t, symbol_hasher> changed_first;
+	for (const auto& sym : affected) {
+		auto it = previous.first_sets.find(sym);
+		if (it == previous.first_sets.end() || it->second != first_sets[sym])
+			changed_first.insert(sym);
+	}
+
+	initialize_lalr1_states();
+
+	// A state keeps the links of the previous state with the same kernel unless its closure
+	// expands a changed non-terminal, or a FIRST set that changed decides closure lookaheads
+	std::map<std::vector<item_id_t>, item_set_id_t> previous_state_of_kernel;
+	for (size_t j = 0; j < previous.lalr1_states.size(); j++)
+		previous_state_of_kernel.emplace(previous.lalr1_states[j]->get_ids(), static_cast<item_set_id_t>(j));
+
+	const frozen_grammar& g = *frozen;
+	using item_index_t = frozen_grammar::item_index_t;
+	std::vector<bool> expands_changed(g.symbol_count(), false), first_changed(g.symbol_count(), false), nullable(g.symbol_count(), false);
+	for (frozen_grammar::symbol_index_t s = 0; s < g.symbol_count(); s++)
+		nullable[s] = can_derive_epsilon(g.symbol(s));
+	for (const auto& sym : changed) {
+		if (g.index_of(sym) != frozen_grammar::INVALID_INDEX)
+			expands_changed[g.index_of(sym)] = true;
+	}
+	for (const auto& sym : changed_first) {
+		if (g.index_of(sym) != frozen_grammar::INVALID_INDEX)
+			first_changed[g.index_of(sym)] = true;
+	}
+
+	std::vector<item_set_id_t> previous_state(lalr1_states.size(), -1);
+	std::vector<item_index_t> kernel, items;
+	lookahead_links.assign(lalr1_states.size(), nullptr);
+	for (size_t i = 0; i < lalr1_states.size(); i++) {
+		auto found = previous_state_of_kernel.find(lalr1_states[i]->get_ids());
+		if (found == previous_state_of_kernel.end())
+			continue;
+
+		kernel.clear();
+		for (const auto& item : lalr1_states[i]->items)
+			kernel.push_back(g.first_item(g.index_of_production(item.product->id)) + item.dot_pos);
+		g.lr0_closure(kernel, items);
+
+		bool unaffected = true;
+		for (item_index_t item : items) {
+			if (g.next_symbol(item) == frozen_grammar::END_OF_RHS)
+				continue;
+			if (expands_changed[g.next_symbol(item)])
+				unaffected = false;
+
+			// closure lookaheads come from FIRST of the symbols after it, up to the first non-nullable one
+			for (item_index_t beta = item + 1; g.next_symbol(beta) != frozen_grammar::END_OF_RHS; beta++) {
+				if (first_changed[g.next_symbol(beta)])
+					unaffected = false;
+				if (!nullable[g.next_symbol(beta)])
+					break;
+			}
+		}
+
+		if (unaffected) {
+			lookahead_links[i] = previous.lookahead_links[found->second];
+			previous_state[i] = found->second;
+		}
+	}
+
+	// The closures of the lookahead and ACTION steps share one arena, released when this returns
+	arena_scope scope(*this);
+	set_lalr1_items_lookaheads();
+
+	// Take over the ACTION rows of unaffected states whose kernel lookaheads came out the same,
+	// unless precedences changed; shifts are renumbered to the states of this automaton
+	bool same_precedences = precedences.size() == previous.precedences.size() &&
+		std::all_of(precedences.begin(), precedences.end(), [&](const auto& entry) {
+			precedence_t other = previous.precedence_of(entry.first);
+			return entry.second.level == other.level && entry.second.assoc == other.assoc;
+		});
+
+	std::vector<bool> prebuilt_rows(lalr1_states.size(), false);
+	for (size_t i = 0; same_precedences && i < lalr1_states.size(); i++) {
+		if (previous_state[i] < 0)
+			continue;
+		const item_set_id_t state = static_cast<item_set_id_t>(i);
+
+		const lalr1_item_set& before = *previous.lalr1_states[previous_state[i]];
+		bool same_lookaheads = std::all_of(lalr1_states[i]->items.begin(), lalr1_states[i]->items.end(), [&](const lalr1_item_t& item) {
+			const lalr1_item_t* other = before.find_item_by_id(item.id);
+			return other != nullptr && other->lookaheads == item.lookaheads;
+		});
+		if (!same_lookaheads)
+			continue;
+
+		auto& row = action_table[state];
+		for (const auto& [sym, action] : previous.action_table.at(previous_state[i])) {
+			row[sym] = action.type == parser_action_type_t::SHIFT
+				? parser_action_t{ parser_action_type_t::SHIFT, goto_table.at({ state, sym }) }
+				: action;
+		}
+		prebuilt_rows[i] = true;
+		stats.rows_reused++;
+	}
+
+	build_action_table(prebuilt_rows);
+	if (profile)
+		renumber_states(*profile);
+}
+
+void parse::lalr_grammar::renumber_states(const state_profile_t& profile)
+{
+	build_stats_t::scoped_phase phase(stats, "renumber_states");
+
+	std::vector<uint64_t> visits(lalr1_states.size());
+	for (size_t i = 0; i < lalr1_states.size(); i++)
+		visits[i] = profile.visits_of(*lalr1_states[i]);
+
+	// Most visited first; state 0 stays where the parser starts, ties keep their order
+	std::vector<item_set_id_t> order(lalr1_states.size());
+	std::iota(order.begin(), order.end(), 0);
+	if (order.size() > 1) {
+		std::stable_sort(order.begin() + 1, order.end(), [&](item_set_id_t a, item_set_id_t b) {
+			return visits[a] > visits[b];
+		});
+	}
+	std::vector<item_set_id_t> new_id(order.size());
+	for (size_t k = 0; k < order.size(); k++)
+		new_id[order[k]] = static_cast<item_set_id_t>(k);
+
+	std::vector<std::shared_ptr<lalr1_item_set>> states(lalr1_states.size());
+	for (size_t i = 0; i < lalr1_states.size(); i++) {
+		lalr1_states[i]->id = new_id[i];
+		states[new_id[i]] = std::move(lalr1_states[i]);
+	}
+	lalr1_states = std::move(states);
+
+	if (lookahead_links.size() == order.size()) {
+		std::vector<std::shared_ptr<const state_lookahead_links_t>> links(order.size());
+		for (size_t i = 0; i < order.size(); i++)
+			links[new_id[i]] = std::move(lookahead_links[i]);
+		lookahead_links = std::move(links);
+	}
+
+	// Remap the state IDs in place: the nodes are re-keyed, their rows are not copied
+	std::vector<decltype(action_table)::node_type> rows;
+	rows.reserve(action_table.size());
+	while (!action_table.empty())
+		rows.push_back(action_table.extract(action_table.begin()));
+	for (auto& row : rows) {
+		row.key() = new_id[row.key()];
+		for (auto& [sym, action] : row.mapped()) {
+			if (action.type == parser_action_type_t::SHIFT)
+				action.value = new_id[action.value];
+		}
+		action_table.insert(std::move(row));
+	}
+
+	std::vector<decltype(goto_table)::node_type> transitions;
+	transitions.reserve(goto_table.size());
+	while (!goto_table.empty())
+		transitions.push_back(goto_table.extract(goto_table.begin()));
+	for (auto& transition : transitions) {
+		transition.key().first = new_id[transition.key().first];
+		transition.mapped() = new_id[transition.mapped()];
+		goto_table.insert(std::move(transition));
+	}
+}
+
+std::string parse::state_profile_t::kernel_of(const lalr1_item_set& state)
+{
+	std::vector<std::string> items;
+	for (const auto& item : state.items) {
+		std::string text = item.product->left.name + " ->";
+		const auto& right = item.product->right;
+		for (size_t i = 0; i <= right.size(); i++) {
+			if (i == static_cast<size_t>(item.dot_pos))
+				text += " .";
+			if (i < right.size() && !right[i].name.empty())
+				text += " " + right[i].name;
+		}
+		items.push_back(std::move(text));
+	}
+	std::sort(items.begin(), items.end());
+
+	std::string kernel;
+	for (const auto& item : items)
+		kernel += (kernel.empty() ? "" : " | ") + item;
+	return kernel;
+}
+
+void parse::state_profile_t::add_visits(const lalr_grammar& grammar, const std::vector<uint64_t>& state_visits)
+{
+	for (size_t i = 0; i < state_visits.size() && i < grammar.lalr1_states.size(); i++) {
+		if (state_visits[i] > 0)
+			visits[kernel_of(*grammar.lalr1_states[i])] += state_visits[i];
+	}
+}
+
+void parse::state_profile_t::save(const std::string& filename) const
+{
+	std::vector<std::pair<std::string, uint64_t>> entries(visits.begin(), visits.end());
+	std::sort(entries.begin(), entries.end(), [](const auto& a, const auto& b) {
+		return a.second != b.second ? a.second > b.second : a.first < b.first;
+	});
+
+	std::ofstream file(filename, std::ios::binary);
+	if (!file)
+		throw std::runtime_error("Cannot write state profile " + filename);
+	file << "# LALR(1) state visits: <visits> TAB <kernel items>\n";
+	for (const auto& [kernel, count] : entries)
+		file << count << '\t' << kernel << '\n';
+	if (!file)
+		throw std::runtime_error("Cannot write state profile " + filename);
+}
+
+parse::state_profile_t parse::state_profile_t::load(const std::string& filename)
+{
+	std::ifstream file(filename, std::ios::binary);
+	if (!file)
+		throw std::runtime_error("Cannot read state profile " + filename);
+
+	state_profile_t profile;
+	std::string line;
+	for (size_t line_number = 1; std::getline(file, line); line_number++) {
+		if (!line.empty() && line.back() == '\r')
+			line.pop_back();
+		if (line.empty() || line[0] == '#')
+			continue;
+
+		size_t tab = line.find('\t');
+		size_t digits = std::find_if(line.begin(), line.end(), [](char c) { return !std::isdigit(static_cast<unsigned char>(c)); }) - line.begin();
+		if (tab == std::string::npos || tab == 0 || digits != tab)
+			throw std::runtime_error("Malformed state profile " + filename + " at line " + std::to_string(line_number));
+		profile.visits[line.substr(tab + 1)] += std::stoull(line.substr(0, tab));
+	}
+	return profile;
+}
+
+namespace {
+
+	using symbol_set_t = std::unordered_set<parse::symbol_t, parse::symbol_hasher>;
+
+	/* Returns the right-hand side with every non-terminal in inlined replaced by the right-hand side of its only production */
+	std::vector<parse::symbol_t> expand_inlined(const parse::lalr_grammar& grammar, const std::vector<parse::symbol_t>& right, const symbol_set_t& inlined)
+	{
+		std::vector<parse::symbol_t> result;
+		for (const auto& sym : right) {
+			if (sym == grammar.epsilon)
+				continue;
+			if (!inlined.count(sym)) {
+				result.push_back(sym);
+				continue;
+			}
+
+			// Inlined non-terminals are never recursive, so the expansion terminates
+			auto expanded = expand_inlined(grammar, grammar.productions.at(sym).front()->right, inlined);
+			result.insert(result.end(), expanded.begin(), expanded.end());
+		}
+
+		if (result.empty())
+			result.push_back(grammar.epsilon);
+		return result;
+	}
+
+	/* Returns true if the grammar with the given non-terminals inlined builds without conflicts */
+	bool builds_with_inlined(const parse::lalr_grammar& grammar, const symbol_set_t& inlined)
+	{
+		parse::lalr_grammar trial;
+		trial.start_symbol = grammar.start_symbol;
+		trial.precedences = grammar.precedences;
+
+		for (const auto& [left, prods] : grammar.productions) {
+			if (inlined.count(left))
+				continue;
+			for (const auto& prod : prods)
+				trial.add_production(left, expand_inlined(grammar, prod->right, inlined))->precedence_symbol = prod->precedence_symbol;
+		}
+
+		trial.collect_conflicts = true;
+		try {
+			trial.build();
+		}
+		catch (const std::exception&) {
+			return false;
+		}
+		return trial.conflicts.empty();
+	}
+
+	void sort_by_name(std::vector<parse::symbol_t>& symbols)
+	{
+		std::sort(symbols.begin(), symbols.end(), [](const parse::symbol_t& a, const parse::symbol_t& b) { return a.name < b.name; });
+	}
+
+}
+
+void parse::lalr_grammar::remove_productions_using(const std::unordered_set<symbol_t, symbol_hasher>& symbols)
+{
+	frozen.reset();
+	for (const auto& sym : symbols) {
+		productions.erase(sym);
+		non_terminals.erase(sym);
+	}
+
+	for (auto& [left, prods] : productions) {
+		prods.erase(std::remove_if(prods.begin(), prods.end(), [&](const std::shared_ptr<production_t>& prod) {
+			return std::any_of(prod->right.begin(), prod->right.end(), [&](const symbol_t& sym) { return symbols.count(sym) > 0; });
+		}), prods.end());
+	}
+}
+
+size_t parse::lalr_grammar::remove_duplicate_productions()
+{
+	frozen.reset();
+	size_t removed = 0;
+	for (auto& [left, prods] : productions) {
+		std::set<std::pair<std::vector<symbol_t>, std::string>> seen;
+		size_t before = prods.size();
+		prods.erase(std::remove_if(prods.begin(), prods.end(), [&](const std::shared_ptr<production_t>& prod) {
+			return !seen.insert({ prod->right, prod->precedence_symbol.name }).second;
+		}), prods.end());
+		removed += before - prods.size();
+	}
+	return removed;
+}
+
+void parse::lalr_grammar::inline_trivial_non_terminals(size_t max_length, normalize_report_t& report)
+{
+	frozen.reset();
+	// Candidates: a single short, non-recursive production without precedence
+	std::vector<symbol_t> candidates;
+	for (const auto& [left, prods] : productions) {
+		if (left == start_symbol || prods.size() != 1 || !prods.front()->precedence_symbol.name.empty())
+			continue;
+
+		const auto& right = prods.front()->right;
+		bool is_epsilon = right.size() == 1 && right[0] == epsilon;
+		if (!is_epsilon && right.size() > max_length)
+			continue;
+
+		bool eligible = true;
+		for (const auto& sym : right) {
+			if (sym == left || (sym.type == symbol_type_t::TERMINAL && precedence_of(sym).level != 0))
+				eligible = false;
+		}
+		if (eligible)
+			candidates.push_back(left);
+	}
+
+	if (candidates.empty())
+		return;
+	sort_by_name(candidates);
+
+	if (!builds_with_inlined(*this, {})) {
+		report.note = "Inlining skipped: the grammar does not build without inlining";
+		return;
+	}
+
+	// Inline all candidates if that builds, otherwise keep them one at a time as long as each still builds
+	symbol_set_t inlined(candidates.begin(), candidates.end());
+	if (!builds_with_inlined(*this, inlined)) {
+		inlined.clear();
+		for (const auto& candidate : candidates) {
+			inlined.insert(candidate);
+			if (!builds_with_inlined(*this, inlined))
+				inlined.erase(candidate);
+		}
+	}
+
+	if (inlined.empty()) {
+		report.note = "Inlining skipped: every candidate introduces conflicts";
+		return;
+	}
+
+	for (auto& [left, prods] : productions) {
+		if (inlined.count(left))
+			continue;
+		for (auto& prod : prods)
+			prod->right = expand_inlined(*this, prod->right, inlined);
+	}
+
+	for (const auto& sym : inlined) {
+		productions.erase(sym);
+		non_terminals.erase(sym);
+		report.inlined.push_back(sym);
+	}
+	sort_by_name(report.inlined);
+}
+
+parse::normalize_report_t parse::lalr_grammar::normalize(bool inline_trivial, size_t max_inline_length)
+{
+	normalize_report_t report;
+	report.productions_before = production_count();
+	auto old_terminals = terminals;
+
+	// Productive non-terminals: those with a production whose non-terminals are all productive
+	std::unordered_set<symbol_t, symbol_hasher> productive;
+	bool changed = true;
+	while (changed) {
+		changed = false;
+		for (const auto& [left, prods] : productions) {
+			if (productive.count(left))
+				continue;
+			for (const auto& prod : prods) {
+				if (std::all_of(prod->right.begin(), prod->right.end(), [&](const symbol_t& sym) {
+					return sym.type != symbol_type_t::NON_TERMINAL || productive.count(sym) > 0;
+				})) {
+					productive.insert(left);
+					changed = true;
+					break;
 				}
 			}
 		}
 	}
+
+	if (!productive.count(start_symbol))
+		throw std::runtime_error("Start symbol " + start_symbol.name + " derives no terminal string");
+
+	std::unordered_set<symbol_t, symbol_hasher> removed;
+	for (const auto& sym : non_terminals) {
+		if (!productive.count(sym)) {
+			removed.insert(sym);
+			report.non_productive.push_back(sym);
+		}
+	}
+	remove_productions_using(removed);
+
+	// Reachable non-terminals: those derived from the start symbol
+	std::unordered_set<symbol_t, symbol_hasher> reachable{ start_symbol };
+	std::vector<symbol_t> worklist{ start_symbol };
+	while (!worklist.empty()) {
+		symbol_t sym = worklist.back();
+		worklist.pop_back();
+		auto it = productions.find(sym);
+		if (it == productions.end())
+			continue;
+		for (const auto& prod : it->second) {
+			for (const auto& next : prod->right) {
+				if (next.type == symbol_type_t::NON_TERMINAL && reachable.insert(next).second)
+					worklist.push_back(next);
+			}
+		}
+	}
+
+	removed.clear();
+	for (const auto& sym : non_terminals) {
+		if (!reachable.count(sym)) {
+			removed.insert(sym);
+			report.unreachable.push_back(sym);
+		}
+	}
+	remove_productions_using(removed);
+
+	report.duplicate_productions = remove_duplicate_productions();
+
+	if (inline_trivial) {
+		inline_trivial_non_terminals(max_inline_length, report);
+		report.duplicate_productions += remove_duplicate_productions();
+	}
+
+	// Recompute the symbol sets from the remaining productions
+	terminals.clear();
+	non_terminals.clear();
+	for (const auto& [left, prods] : productions) {
+		non_terminals.insert(left);
+		for (const auto& prod : prods) {
+			for (const auto& sym : prod->right) {
+				if (sym.type == symbol_type_t::TERMINAL && sym.name != epsilon.name)
+					terminals.insert(sym);
+				else if (sym.type == symbol_type_t::NON_TERMINAL)
+					non_terminals.insert(sym);
+			}
+		}
+	}
+
+	for (const auto& sym : old_terminals) {
+		if (!terminals.count(sym))
+			report.unused_terminals.push_back(sym);
+	}
+
+	sort_by_name(report.non_productive);
+	sort_by_name(report.unreachable);
+	sort_by_name(report.unused_terminals);
+	report.productions_after = production_count();
+	return report;
+}
+
+namespace {
+
+	/* Returns the length of one array holding sparse rows (sorted columns) by row displacement: first fit, longest rows first, each row at a base of its own */
+	size_t packed_length(std::vector<std::vector<size_t>> rows)
+	{
+		std::sort(rows.begin(), rows.end(), [](const auto& a, const auto& b) { return a.size() > b.size(); });
+
+		std::vector<bool> used, base_taken;
+		size_t length = 0, first_free = 0;
+		for (const auto& row : rows) {
+			if (row.empty())
+				continue;
+
+			size_t base = first_free > row[0] ? first_free - row[0] : 0;
+			for (;; base++) {
+				if (base < base_taken.size() && base_taken[base])
+					continue;
+				bool fits = std::none_of(row.begin(), row.end(), [&](size_t col) {
+					return base + col < used.size() && used[base + col];
+				});
+				if (fits)
+					break;
+			}
+
+			if (used.size() < base + row.back() + 1)
+				used.resize(base + row.back() + 1, false);
+			if (base_taken.size() <= base)
+				base_taken.resize(base + 1, false);
+			base_taken[base] = true;
+			for (size_t col : row)
+				used[base + col] = true;
+			while (first_free < used.size() && used[first_free])
+				first_free++;
+			length = std::max(length, base + row.back() + 1);
+		}
+		return length;
+	}
+
+}
+
+parse::table_footprint_t parse::lalr_grammar::footprint() const
+{
+	table_footprint_t fp;
+	if (lalr1_states.empty() || !frozen)
+		return fp;
+
+	constexpr size_t CELL = 4;
+	const frozen_grammar& g = *frozen;
+
+	// Columns: terminals, end marker included, and non-terminals, by name
+	std::vector<symbol_t> terminal_columns(terminals.begin(), terminals.end()), non_terminal_columns(non_terminals.begin(), non_terminals.end());
+	for (const auto& [state, row] : action_table) {
+		for (const auto& entry : row) {
+			if (std::find(terminal_columns.begin(), terminal_columns.end(), entry.first) == terminal_columns.end())
+				terminal_columns.push_back(entry.first);
+		}
+	}
+	auto by_name = [](const symbol_t& a, const symbol_t& b) { return a.name < b.name; };
+	std::sort(terminal_columns.begin(), terminal_columns.end(), by_name);
+	std::sort(non_terminal_columns.begin(), non_terminal_columns.end(), by_name);
+	std::unordered_map<symbol_t, size_t, symbol_hasher> column;
+	for (size_t c = 0; c < terminal_columns.size(); c++)
+		column[terminal_columns[c]] = c;
+	for (size_t c = 0; c < non_terminal_columns.size(); c++)
+		column[non_terminal_columns[c]] = c;
+
+	fp.states = lalr1_states.size();
+	fp.terminals = terminal_columns.size();
+	fp.non_terminals = non_terminal_columns.size();
+	fp.productions = production_count();
+
+	// Items, and the states each production appears in
+	std::unordered_map<production_id_t, size_t> states_of_production;
+	std::vector<frozen_grammar::item_index_t> kernel, items;
+	for (const auto& state : lalr1_states) {
+		kernel.clear();
+		std::unordered_set<production_id_t> in_kernel;
+		for (const auto& item : state->items) {
+			kernel.push_back(g.first_item(g.index_of_production(item.product->id)) + item.dot_pos);
+			in_kernel.insert(item.product->id);
+		}
+		g.lr0_closure(kernel, items);
+		fp.kernel_items += kernel.size();
+		fp.closure_items += items.size();
+		for (production_id_t id : in_kernel)
+			states_of_production[id]++;
+	}
+
+	for (const auto& [id, count] : states_of_production) {
+		auto prod = get_production_by_id(id);
+		fp.states_by_production.push_back({ id, prod ? prod->to_string() : "[ID: " + std::to_string(id) + " ]", count });
+	}
+	std::sort(fp.states_by_production.begin(), fp.states_by_production.end(), [](const auto& a, const auto& b) {
+		return a.states != b.states ? a.states > b.states : a.id < b.id;
+	});
+
+	// ACTION rows
+	using cell_t = std::pair<size_t, int64_t>;  // Column and encoded action
+	auto encode = [](const parser_action_t& action) {
+		return (static_cast<int64_t>(action.type) << 32) | static_cast<uint32_t>(action.value);
+	};
+
+	std::set<std::vector<cell_t>> action_rows;
+	std::vector<std::vector<size_t>> packed_action_rows;
+	for (const auto& [state, row] : action_table) {
+		std::vector<cell_t> cells;
+		std::unordered_map<production_id_t, size_t> reductions;
+		bool only_reductions = !row.empty();
+		for (const auto& [sym, action] : row) {
+			cells.push_back({ column[sym], encode(action) });
+			fp.action_entries++;
+			switch (action.type) {
+			case parser_action_type_t::SHIFT:
+				fp.shift_entries++;
+				only_reductions = false;
+				break;
+			case parser_action_type_t::REDUCE:
+				fp.reduce_entries++;
+				reductions[action.value]++;
+				break;
+			case parser_action_type_t::ACCEPT:
+				fp.reduce_entries++;
+				only_reductions = false;
+				break;
+			default:
+				fp.error_entries++;
+				only_reductions = false;
+				break;
+			}
+		}
+		if (only_reductions && reductions.size() == 1)
+			fp.default_reducible_states++;
+
+		std::sort(cells.begin(), cells.end());
+		if (!action_rows.insert(cells).second)
+			continue;
+
+		// The most frequent reduction becomes the default of the row and is not stored
+		production_id_t default_reduction = -1;
+		size_t most = 0;
+		for (const auto& [id, count] : reductions) {
+			if (count > most || (count == most && id < default_reduction)) {
+				most = count;
+				default_reduction = id;
+			}
+		}
+
+		std::vector<size_t> columns;
+		for (const auto& [col, action] : cells) {
+			if (most > 0 && action == encode({ parser_action_type_t::REDUCE, default_reduction }))
+				continue;
+			columns.push_back(col);
+		}
+		packed_action_rows.push_back(std::move(columns));
+	}
+	fp.distinct_action_rows = action_rows.size();
+
+	// GOTO rows, and columns for packing
+	std::unordered_map<item_set_id_t, std::vector<cell_t>> goto_rows;
+	std::vector<std::unordered_map<item_set_id_t, std::vector<size_t>>> targets_of_column(non_terminal_columns.size());
+	for (const auto& [key, target] : goto_table) {
+		if (key.second.type != symbol_type_t::NON_TERMINAL)
+			continue;
+		size_t col = column[key.second];
+		goto_rows[key.first].push_back({ col, target });
+		targets_of_column[col][target].push_back(static_cast<size_t>(key.first));
+		fp.goto_entries++;
+	}
+
+	std::set<std::vector<cell_t>> distinct_goto_rows;
+	for (auto& [state, cells] : goto_rows) {
+		std::sort(cells.begin(), cells.end());
+		distinct_goto_rows.insert(cells);
+	}
+	fp.distinct_goto_rows = distinct_goto_rows.size();
+
+	std::vector<std::vector<size_t>> packed_goto_columns;
+	for (const auto& targets : targets_of_column) {
+		// The most frequent target becomes the default of the column and is not stored
+		item_set_id_t default_target = -1;
+		size_t most = 0;
+		for (const auto& [target, from] : targets) {
+			if (from.size() > most || (from.size() == most && target < default_target)) {
+				most = from.size();
+				default_target = target;
+			}
+		}
+
+		std::vector<size_t> states;
+		for (const auto& [target, from] : targets) {
+			if (target != default_target)
+				states.insert(states.end(), from.begin(), from.end());
+		}
+		std::sort(states.begin(), states.end());
+		packed_goto_columns.push_back(std::move(states));
+	}
+
+	fp.action_density = fp.states * fp.terminals > 0 ? static_cast<double>(fp.action_entries) / (fp.states * fp.terminals) : 0;
+	fp.goto_density = fp.states * fp.non_terminals > 0 ? static_cast<double>(fp.goto_entries) / (fp.states * fp.non_terminals) : 0;
+
+	fp.hash_map_bytes = tables_memory_size();
+
+	fp.dense_bytes = CELL * fp.states * (fp.terminals + fp.non_terminals);
+
+	// Compressed: row index and default per state, base per distinct row, value and check per packed cell; base and default per GOTO column
+	fp.compressed_bytes = CELL * (2 * fp.states + fp.distinct_action_rows + 2 * packed_length(packed_action_rows))
+		+ CELL * (2 * fp.non_terminals + 2 * packed_length(packed_goto_columns));
+	return fp;
 }
@@ -15,24 +15,186 @@
 
 
 
+namespace {
+
+	/* Token stream over (symbol, lexeme) pairs */
+	struct pair_token_stream {
+		const std::vector<std::pair<parse::symbol_t, std::string>>& tokens;
+		const parse::symbol_t& end_marker;
+		size_t index = 0;
+
+		const parse::symbol_t& peek() const {
+			return index < tokens.size() ? tokens[index].first : end_marker;
+		}
+
+		void advance() {
+			index++;
+		}
+	};
+
+	/* Token stream over compact tokens, resolving terminal IDs through the lexer that produced them */
+	struct span_token_stream {
+		const std::vector<parse::token_t>& tokens;
+		const parse::lexer& lex;
+		const parse::symbol_t& end_marker;
+		size_t index = 0;
+
+		const parse::symbol_t& peek() const {
+			return index < tokens.size() ? lex.symbol_of(tokens[index].terminal) : end_marker;
+		}
+
+		void advance() {
+			index++;
+		}
+	};
+
+	/* Token stream pulling tokens from the lexer on demand through a one-token lookahead buffer */
+	struct lexer_token_stream {
+		parse::lexer& lex;
+		parse::token_t lookahead;
+
+		/* Takes a lexer on which begin() has already been called */
+		explicit lexer_token_stream(parse::lexer& l) : lex(l) {
+			lookahead = lex.next_token();
+		}
+
+		const parse::symbol_t& peek() const {
+			return lex.symbol_of(lookahead.terminal);
+		}
+
+		void advance() {
+			lookahead = lex.next_token();
+		}
+	};
+
+	/*
+	 * Token stream lexing each token with the terminal set of the state it is read in
+	 * Tokens are lexed lazily on the first peek() after a shift, when the state on top of the
+	 * stack is the one the token will be looked up in.
+	 */
+	struct context_token_stream {
+		parse::lexer& lex;
+		const std::stack<item_set_id_t>& states;
+		const std::vector<parse::terminal_mask>& masks;
+		parse::token_t lookahead{};
+		bool pending = true;
+
+		const parse::symbol_t& peek() {
+			if (pending) {
+				lookahead = lex.next_token(masks[states.top()]);
+				pending = false;
+			}
+			return lex.symbol_of(lookahead.terminal);
+		}
+
+		void advance() {
+			pending = true;
+		}
+	};
+
+	/* Counts a parse in a counter slot when run() returns, however it returns */
+	struct parse_count_scope {
+		parse::parser_counters::slot_t* slot;
+		uint64_t shifts_before = slot != nullptr ? slot->shifts.load() : 0;
+		bool accepted = false;
+
+		~parse_count_scope() {
+			if (slot != nullptr)
+				slot->end_parse(slot->shifts.load() - shifts_before, accepted);
+		}
+	};
+
+}
+
 parse::lr_parser::parse_result parse::lr_parser::parse(const std::vector<std::pair<parse::symbol_t, std::string>>& input_tokens)
+{
+	pair_token_stream stream{ input_tokens, grammar->end_marker };
+	return run(stream);
+}
+
+parse::lr_parser::parse_result parse::lr_parser::parse(const std::vector<parse::token_t>& input_tokens, const parse::lexer& lex)
+{
+	span_token_stream stream{ input_tokens, lex, grammar->end_marker };
+	return run(stream);
+}
+
+parse::lr_parser::parse_result parse::lr_parser::parse(parse::lexer& lex, std::string_view input)
+{
+	lex.begin(input);
+	return run_lexer(lex);
+}
+
+parse::lr_parser::parse_result parse::lr_parser::parse(parse::lexer& lex, parse::source_buffer& src)
+{
+	lex.begin(src);
+	return run_lexer(lex);
+}
+
+parse::lr_parser::parse_result parse::lr_parser::run_lexer(parse::lexer& lex)
+{
+	if (!context_aware_lexing) {
+		lexer_token_stream stream(lex);
+		return run(stream);
+	}
+
+	if (state_masks_lexer != &lex || state_masks_terminals != lex.terminal_count())
+		build_state_masks(lex);
+
+	context_token_stream stream{ lex, state_stack, state_masks };
+	return run(stream);
+}
+
+void parse::lr_parser::build_state_masks(const parse::lexer& lex)
+{
+	size_t state_count = grammar->lalr1_states.size();
+	for (const auto& row : grammar->action_table)
+		state_count = std::max(state_count, static_cast<size_t>(row.first) + 1);
+
+	state_masks.assign(state_count, parse::terminal_mask());
+	for (const auto& row : grammar->action_table) {
+		parse::terminal_mask& mask = state_masks[row.first];
+		for (const auto& action : row.second) {
+			if (action.second.type == parser_action_type_t::ERROR)
+				continue;
+
+			// 词法分析器无法产生的终结符不参与掩码
+			terminal_id_t id = lex.terminal_id_of(action.first);
+			if (id != INVALID_TERMINAL_ID)
+				mask.set(id);
+		}
+	}
+
+	state_masks_lexer = &lex;
+	state_masks_terminals = lex.terminal_count();
+}
+
+template <typename token_stream_t>
+parse::lr_parser::parse_result parse::lr_parser::run(token_stream_t& stream)
 {
 	parse_history.clear();
+	state_stack = {};
+	state_stack.push(0);
+	symbol_stack = {};
 	symbol_stack.push(parse::symbol_t{ "$", parse::symbol_type_t::TERMINAL });
 
-	size_t index = 0;
-	std::vector<std::pair<parse::symbol_t, std::string>> tokens = input_tokens;
-	tokens.push_back({ grammar->end_marker, "$" });
-
 #ifdef __LALR1_PARSER_HISTORY_INFO__
 	parse_history.push_back("Start parsing...");
 #endif
 
+#ifdef __LALR1_PARSER_COUNTERS__
+	parse_count_scope counting{ counter_slot };
+#endif
+
 	while (true)
 	{
 		item_set_id_t current_state = state_stack.top();
 
-		parse::symbol_t current_token = tokens[index].first;
+		const parse::symbol_t& current_token = stream.peek();
+
+#ifdef __LALR1_PARSER_COUNTERS__
+		if (counting.slot != nullptr)
+			counting.slot->visit(current_state);
+#endif
 
 #ifdef __LALR1_PARSER_HISTORY_INFO__
 		std::string state_info = " State: " + std::to_string(current_state) +
@@ -44,11 +206,20 @@ parse::lr_parser::parse_result parse::lr_parser::parse(const std::vector<std::pa
 #endif
 
 
-		if (grammar->action_table[current_state].find(current_token) != grammar->action_table[current_state].end()) {
+		// look up without inserting: the grammar may be shared with parsers on other threads
+		const parser_action_t* action = nullptr;
+		auto row_it = grammar->action_table.find(current_state);
+		if (row_it != grammar->action_table.end()) {
+			auto action_it = row_it->second.find(current_token);
+			if (action_it != row_it->second.end())
+				action = &action_it->second;
+		}
+
+		if (action != nullptr) {
 
 			// If we found the corresponding action.
 
-			parser_action_t a = grammar->action_table[current_state][current_token];
+			parser_action_t a = *action;
 
 			switch (a.type)
 			{
@@ -56,7 +227,12 @@ parse::lr_parser::parse_result parse::lr_parser::parse(const std::vector<std::pa
 
 				state_stack.push(a.value);
 				symbol_stack.push(current_token);
-				index++;
+				stream.advance();
+
+#ifdef __LALR1_PARSER_COUNTERS__
+				if (counting.slot != nullptr)
+					counting.slot->shift(state_stack.size());
+#endif
 
 #ifdef __LALR1_PARSER_HISTORY_INFO__
 				parse_history.push_back("Shift to state " + std::to_string(a.value));
@@ -70,6 +246,11 @@ parse::lr_parser::parse_result parse::lr_parser::parse(const std::vector<std::pa
 				auto prod = grammar->get_production_by_id(a.value);
 				bool is_epsilon = (prod->right.size() == 1 && prod->right[0] == grammar->epsilon);
 
+#ifdef __LALR1_PARSER_COUNTERS__
+				if (counting.slot != nullptr)
+					counting.slot->reduce(a.value);
+#endif
+
 #ifdef __LALR1_PARSER_HISTORY_INFO__
 				parse_history.push_back("Reduce: " + prod->to_string());
 				if (is_epsilon) {
@@ -101,13 +282,19 @@ parse::lr_parser::parse_result parse::lr_parser::parse(const std::vector<std::pa
 				item_set_id_t new_state = state_stack.top();
 				symbol_t non_terminal = prod->left;
 				auto goto_key = std::make_pair(new_state, non_terminal);
-				if (grammar->goto_table.find(goto_key) != grammar->goto_table.end())
+				auto goto_it = grammar->goto_table.find(goto_key);
+				if (goto_it != grammar->goto_table.end())
 				{
-					item_set_id_t next_state = grammar->goto_table[goto_key];
+					item_set_id_t next_state = goto_it->second;
 
 					state_stack.push(next_state);
 					symbol_stack.push(non_terminal);
 
+#ifdef __LALR1_PARSER_COUNTERS__
+					if (counting.slot != nullptr)
+						counting.slot->go_to(state_stack.size());
+#endif
+
 #ifdef __LALR1_PARSER_HISTORY_INFO__
 					parse_history.push_back("Shift to state: " + std::to_string(next_state));
 #endif
@@ -126,6 +313,10 @@ parse::lr_parser::parse_result parse::lr_parser::parse(const std::vector<std::pa
 #ifdef __LALR1_PARSER_HISTORY_INFO__
 				parse_history.push_back("Accept input.");
 #endif
+
+#ifdef __LALR1_PARSER_COUNTERS__
+				counting.accepted = true;
+#endif
 				return { true, "", parse_history };
 			}
 
@@ -172,56 +363,421 @@ parse::lr_parser::parse_result parse::lr_parser::parse(const std::vector<std::pa
 	return parse_result();
 }
 
-std::vector<std::pair<parse::symbol_t, std::string>> parse::lexer::tokenize(const std::string& input)
+parse::parser_counters::parser_counters(const lalr_grammar& g)
+	: grammar(&g), production_count(static_cast<size_t>(g.next_production_id)), state_count(g.lalr1_states.size())
 {
-	std::vector<std::pair<parse::symbol_t, std::string>> tokens;
-	size_t pos = 0;
-	line_number = 1;
-	column_number = 1;
+	if (state_count == 0)
+		throw std::invalid_argument("parser_counters needs a grammar whose tables are built");
+}
+
+parse::parser_counters::slot_t& parse::parser_counters::acquire()
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	if (!free_slots.empty()) {
+		slot_t* slot = free_slots.back();
+		free_slots.pop_back();
+		return *slot;
+	}
+
+	auto slot = std::make_unique<slot_t>();
+	const size_t production_lines = (production_count + COUNTERS_PER_LINE - 1) / COUNTERS_PER_LINE;
+	const size_t state_lines = (state_count + COUNTERS_PER_LINE - 1) / COUNTERS_PER_LINE;
+	slot->histograms = std::make_unique<counter_line_t[]>(production_lines + state_lines);
+	slot->state_line = production_lines;
+	slots.push_back(std::move(slot));
+	return *slots.back();
+}
+
+void parse::parser_counters::release(slot_t& slot)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	free_slots.push_back(&slot);
+}
+
+parse::parser_counts_t parse::parser_counters::collect() const
+{
+	parser_counts_t counts;
+	counts.tokens_per_parse.assign(TOKEN_BUCKETS, 0);
+	counts.reductions_by_production.assign(production_count, 0);
+	counts.state_visits.assign(state_count, 0);
+
+	std::lock_guard<std::mutex> lock(mutex);
+	for (const auto& slot : slots) {
+		counts.parses += slot->parses.load();
+		counts.accepted += slot->accepted.load();
+		counts.shifts += slot->shifts.load();
+		counts.reductions += slot->reductions.load();
+		counts.gotos += slot->gotos.load();
+		counts.max_stack_depth = std::max(counts.max_stack_depth, slot->max_stack_depth.load());
+		counts.max_tokens = std::max(counts.max_tokens, slot->max_tokens.load());
+		for (size_t b = 0; b < TOKEN_BUCKETS; b++)
+			counts.tokens_per_parse[b] += slot->tokens_per_parse[b].load();
+		for (size_t p = 0; p < production_count; p++)
+			counts.reductions_by_production[p] += slot->production_reductions(static_cast<production_id_t>(p)).load();
+		for (size_t s = 0; s < state_count; s++)
+			counts.state_visits[s] += slot->state_visits(static_cast<item_set_id_t>(s)).load();
+	}
+	counts.tokens = counts.shifts;
+	return counts;
+}
+
+void parse::parser_counters::reset()
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	for (const auto& slot : slots) {
+		for (counter_t* c : { &slot->parses, &slot->accepted, &slot->shifts, &slot->reductions, &slot->gotos, &slot->max_stack_depth, &slot->max_tokens })
+			c->reset();
+		for (size_t b = 0; b < TOKEN_BUCKETS; b++)
+			slot->tokens_per_parse[b].reset();
+		for (size_t p = 0; p < production_count; p++)
+			slot->production_reductions(static_cast<production_id_t>(p)).reset();
+		for (size_t s = 0; s < state_count; s++)
+			slot->state_visits(static_cast<item_set_id_t>(s)).reset();
+	}
+}
+
+namespace {
+
+	/* Returns the n largest entries of a histogram as (index, count), largest first, ties by index */
+	template <typename index_t>
+	std::vector<std::pair<index_t, uint64_t>> top_entries(const std::vector<uint64_t>& histogram, size_t n)
+	{
+		std::vector<std::pair<index_t, uint64_t>> entries;
+		for (size_t i = 0; i < histogram.size(); i++) {
+			if (histogram[i] > 0)
+				entries.push_back({ static_cast<index_t>(i), histogram[i] });
+		}
+
+		auto larger = [](const auto& a, const auto& b) {
+			return a.second != b.second ? a.second > b.second : a.first < b.first;
+		};
+		n = std::min(n, entries.size());
+		std::partial_sort(entries.begin(), entries.begin() + n, entries.end(), larger);
+		entries.resize(n);
+		return entries;
+	}
+
+	std::string percent_of(uint64_t part, uint64_t whole)
+	{
+		std::ostringstream out;
+		out << std::fixed << std::setprecision(1) << (whole > 0 ? 100.0 * part / whole : 0.0) << "%";
+		return out.str();
+	}
+
+}
+
+std::vector<std::pair<production_id_t, uint64_t>> parse::parser_counts_t::top_productions(size_t n) const
+{
+	return top_entries<production_id_t>(reductions_by_production, n);
+}
+
+std::vector<std::pair<item_set_id_t, uint64_t>> parse::parser_counts_t::top_states(size_t n) const
+{
+	return top_entries<item_set_id_t>(state_visits, n);
+}
+
+std::string parse::parser_counts_t::to_string(const lalr_grammar& grammar, size_t top) const
+{
+	std::ostringstream out;
+	out << "Parses: " << parses << " (" << accepted << " accepted), tokens: " << tokens
+		<< " (" << std::fixed << std::setprecision(1) << (parses > 0 ? static_cast<double>(tokens) / parses : 0.0)
+		<< " per parse, at most " << max_tokens << ")\n"
+		<< "Shifts: " << shifts << ", reductions: " << reductions << ", GOTOs: " << gotos
+		<< ", deepest stack: " << max_stack_depth << "\n";
+
+	out << "Tokens per parse:\n";
+	for (size_t b = 0; b < tokens_per_parse.size(); b++) {
+		if (tokens_per_parse[b] == 0)
+			continue;
+		std::string range = b == 0 ? "0" : std::to_string(1ull << (b - 1)) + "-" + std::to_string((1ull << b) - 1);
+		out << "  " << std::left << std::setw(16) << range << std::right << std::setw(12) << tokens_per_parse[b] << "\n";
+	}
+
+	out << "Productions reduced most:\n";
+	for (const auto& [id, count] : top_productions(top)) {
+		auto prod = grammar.get_production_by_id(id);
+		out << "  " << std::setw(12) << count << std::setw(8) << percent_of(count, reductions) << "  "
+			<< (prod ? prod->to_string() : "[ID: " + std::to_string(id) + " ]") << "\n";
+	}
+
+	uint64_t visits = 0;
+	for (uint64_t count : state_visits)
+		visits += count;
+
+	out << "States visited most:\n";
+	for (const auto& [state, count] : top_states(top))
+		out << "  " << std::setw(12) << count << std::setw(8) << percent_of(count, visits) << "  state " << state << "\n";
+	return out.str();
+}
+
+void parse::lexer::begin(std::string_view input)
+{
+	source = input;
+	cursor = 0;
+	streamed_input = nullptr;
+	window_offset = 0;
+	line_base = 1;
+	column_base = 1;
+	lines.clear();
 	errors.clear();
+}
 
-	while (pos < input.size()) {
-		// 跳过空白字符和注释
-		skip_whitespace_and_comments(input, pos);
-		if (pos >= input.size()) break;
-
-		// 尝试匹配所有模式
-		bool matched = false;
-		size_t max_match_length = 0;
-		parse::symbol_t matched_symbol;
-		std::string matched_lexeme;
-
-		for (const auto& pattern : token_patterns) {
-			std::smatch match;
-			std::string remaining_input = input.substr(pos);
-
-			if (std::regex_search(remaining_input, match, pattern.first,
-				std::regex_constants::match_continuous)) {
-				if (match.length() > max_match_length) {
-					max_match_length = match.length();
-					matched_symbol = pattern.second;
-					matched_lexeme = match.str();
-					matched = true;
-				}
+void parse::lexer::begin(parse::source_buffer& src)
+{
+	begin(src.window());
+	streamed_input = &src;
+	window_offset = src.window_offset();
+}
+
+size_t parse::lexer::match_patterns(const terminal_mask* acceptable, terminal_id_t& matched) const
+{
+	const char* const input_end = source.data() + source.size();
+	size_t max_match_length = 0;
+	matched = INVALID_TERMINAL_ID;
+
+	for (const auto& pattern : token_patterns) {
+		if (acceptable != nullptr && !acceptable->test(pattern.second))
+			continue;
+
+		std::cmatch match;
+		if (std::regex_search(source.data() + cursor, input_end, match, pattern.first,
+			std::regex_constants::match_continuous)) {
+			if (static_cast<size_t>(match.length()) > max_match_length) {
+				max_match_length = match.length();
+				matched = pattern.second;
 			}
 		}
+	}
+
+	return max_match_length;
+}
 
-		if (matched) {
-			tokens.emplace_back(matched_symbol, matched_lexeme);
-			pos += max_match_length;
-			column_number += max_match_length;
+parse::token_t parse::lexer::lex_token(const terminal_mask* acceptable)
+{
+	while (true) {
+		const bool final_input = window_is_final();
+
+		// 跳过空白字符和注释；流式输入时保证记号起点之后有足够的缓冲
+		if (!skip_whitespace_and_comments(source, cursor, final_input) ||
+			(!final_input && source.size() - cursor < stream_lookahead)) {
+			if (refill_window())
+				continue;
 		}
-		else {
-			// 无法识别的字符
-			std::string invalid_char(1, input[pos]);
-			add_error("Unrecognized character: '" + invalid_char + "'");
-			pos++;
-			column_number++;
+		if (cursor >= source.size()) break;
+
+		// 标识符与关键字：扫描一次标识符，再查关键字表
+		if (is_identifier_start(source[cursor])) {
+			size_t end = cursor + 1;
+			while (end < source.size() && is_identifier_char(source[end]))
+				end++;
+
+			// 标识符可能跨越窗口末尾
+			if (end == source.size() && refill_window())
+				continue;
+
+			terminal_id_t terminal = keywords.find(source.substr(cursor, end - cursor));
+			// 当前状态不接受该关键字而接受标识符时，按标识符处理
+			if (terminal == INVALID_TERMINAL_ID ||
+				(acceptable != nullptr && !acceptable->test(terminal) && acceptable->test(identifier_terminal)))
+				terminal = identifier_terminal;
+
+			token_t tok{ window_offset + cursor, static_cast<uint32_t>(end - cursor), terminal };
+			intern_lexeme(tok);
+			cursor = end;
+			return tok;
 		}
+
+		// 只尝试当前状态可接受的模式；都不匹配时退回到所有模式，由语法分析器报告错误
+		terminal_id_t matched_terminal;
+		size_t max_match_length = match_patterns(acceptable, matched_terminal);
+		if (matched_terminal == INVALID_TERMINAL_ID && acceptable != nullptr)
+			max_match_length = match_patterns(nullptr, matched_terminal);
+
+		// 匹配失败或匹配到窗口末尾时，记号可能跨越窗口
+		if ((matched_terminal == INVALID_TERMINAL_ID || cursor + max_match_length == source.size()) && refill_window())
+			continue;
+
+		if (matched_terminal != INVALID_TERMINAL_ID) {
+			token_t tok{ window_offset + cursor, static_cast<uint32_t>(max_match_length), matched_terminal };
+			intern_lexeme(tok);
+			cursor += max_match_length;
+			return tok;
+		}
+
+		// 无法识别的字符
+		std::string invalid_char(1, source[cursor]);
+		add_error("Unrecognized character: '" + invalid_char + "'", cursor);
+		cursor++;
 	}
 
 	// 添加结束标记
-	tokens.emplace_back(end_marker, "$");
+	return { window_offset + source.size(), 0, END_MARKER_TERMINAL_ID };
+}
+
+std::vector<parse::token_t> parse::lexer::tokenize_spans(std::string_view input)
+{
+	std::vector<parse::token_t> tokens;
+	begin(input);
+
+	do {
+		tokens.push_back(next_token());
+	} while (tokens.back().terminal != END_MARKER_TERMINAL_ID);
+
+	return tokens;
+}
+
+parse::lexer::speculative_run_t parse::lexer::lex_range(std::string_view input, size_t from, size_t limit) const
+{
+	lexer worker = *this;
+	worker.begin(input);
+	worker.cursor = from;
+	worker.defer_errors = true;
+	worker.pool = nullptr;
+
+	speculative_run_t run;
+	run.start = from;
+
+	while (worker.cursor < limit) {
+		token_t tok = worker.next_token();
+		if (tok.terminal == END_MARKER_TERMINAL_ID) {
+			worker.cursor = input.size();
+			break;
+		}
+		run.tokens.push_back(tok);
+	}
+
+	run.end = worker.cursor;
+	run.errors = std::move(worker.deferred_errors);
+	return run;
+}
+
+std::vector<parse::token_t> parse::lexer::tokenize_parallel(std::string_view input, size_t thread_count, size_t min_chunk_size)
+{
+	if (thread_count == 0)
+		thread_count = std::max(1u, std::thread::hardware_concurrency());
+
+	size_t chunk_count = std::min(thread_count, input.size() / std::max<size_t>(min_chunk_size, 1));
+	if (chunk_count < 2)
+		return tokenize_spans(input);
+
+	std::vector<size_t> bounds(chunk_count + 1);
+	for (size_t i = 0; i <= chunk_count; i++)
+		bounds[i] = input.size() / chunk_count * i;
+	bounds[chunk_count] = input.size();
+
+	// 每个分块先假定分块起点位于记号之间，推测性地分析
+	std::vector<std::vector<speculative_run_t>> runs(chunk_count);
+	std::vector<std::thread> workers;
+
+	for (size_t i = 0; i < chunk_count; i++) {
+		workers.emplace_back([this, input, &bounds, &runs, i]() {
+			runs[i].push_back(lex_range(input, bounds[i], bounds[i + 1]));
+		});
+	}
+	for (auto& worker : workers)
+		worker.join();
+	workers.clear();
+
+	// 上一块的推测结果结束处不是本块的记号边界时，分块起点可能位于块注释或行注释内：
+	// 只为这些分块再从注释结束之后分析，每种上下文一个任务
+	// 推测结果中从 pos 开始的第一个记号；pos 不是其记号边界时为 npos
+	auto first_token_at = [](const speculative_run_t& run, size_t pos) -> size_t {
+		if (run.start == pos)
+			return 0;
+		auto it = std::lower_bound(run.tokens.begin(), run.tokens.end(), pos,
+			[](const token_t& tok, size_t p) { return tok.offset + tok.length < p; });
+		if (it == run.tokens.end() || it->offset + it->length != pos)
+			return std::string_view::npos;
+		return static_cast<size_t>(it - run.tokens.begin()) + 1;
+	};
+
+	struct alternative_t {
+		size_t chunk;
+		size_t from;
+		speculative_run_t run;
+	};
+	std::vector<alternative_t> alternatives;
+	for (size_t i = 1; i < chunk_count; i++) {
+		const speculative_run_t& previous = runs[i - 1].front();
+		if (previous.end >= bounds[i + 1] || first_token_at(runs[i].front(), previous.end) != std::string_view::npos)
+			continue;
+
+		// 只在本块之内查找注释结束
+		std::string_view chunk = input.substr(0, bounds[i + 1]);
+		size_t comment_end = chunk.find("*/", bounds[i]);
+		if (comment_end != std::string_view::npos && comment_end + 2 < bounds[i + 1])
+			alternatives.push_back({ i, comment_end + 2, {} });
+		size_t line_end = chunk.find('\n', bounds[i]);
+		if (line_end != std::string_view::npos && line_end + 1 < bounds[i + 1])
+			alternatives.push_back({ i, line_end + 1, {} });
+	}
+
+	for (auto& alternative : alternatives) {
+		workers.emplace_back([this, input, &bounds, &alternative]() {
+			alternative.run = lex_range(input, alternative.from, bounds[alternative.chunk + 1]);
+		});
+	}
+	for (auto& worker : workers)
+		worker.join();
+	for (auto& alternative : alternatives)
+		runs[alternative.chunk].push_back(std::move(alternative.run));
+
+	// 按顺序拼接：在推测结果中寻找与上一块结束位置重合的记号边界，找不到则从该位置重新分析
+	begin(input);
+	std::vector<token_t> tokens;
+	size_t resume = 0;
+
+	auto emit = [&](speculative_run_t& run, size_t first_token) {
+		size_t first_new = tokens.size();
+		tokens.insert(tokens.end(), run.tokens.begin() + first_token, run.tokens.end());
+		// 字符串池不是线程安全的，拼接时按记号顺序驻留，原子编号与串行分析一致
+		for (size_t i = first_new; i < tokens.size(); i++)
+			intern_lexeme(tokens[i]);
+		for (const auto& error : run.errors) {
+			if (error.first >= resume)
+				add_error(error.second, error.first);
+		}
+		resume = run.end;
+	};
+
+	for (size_t i = 0; i < chunk_count; i++) {
+		if (resume >= bounds[i + 1])
+			continue;
+
+		bool stitched = false;
+		for (auto& run : runs[i]) {
+			size_t first_token = first_token_at(run, resume);
+			if (first_token == std::string_view::npos)
+				continue;
+			emit(run, first_token);
+			stitched = true;
+			break;
+		}
+
+		if (!stitched) {
+			speculative_run_t run = lex_range(input, resume, bounds[i + 1]);
+			emit(run, 0);
+		}
+	}
+
+	cursor = input.size();
+	tokens.push_back({ input.size(), 0, END_MARKER_TERMINAL_ID });
+	return tokens;
+}
+
+std::vector<std::pair<parse::symbol_t, std::string>> parse::lexer::tokenize(const std::string& input)
+{
+	std::vector<parse::token_t> spans = tokenize_spans(input);
+
+	std::vector<std::pair<parse::symbol_t, std::string>> tokens;
+	tokens.reserve(spans.size());
+
+	for (const auto& tok : spans) {
+		if (tok.terminal == END_MARKER_TERMINAL_ID)
+			tokens.emplace_back(end_marker, "$");
+		else
+			tokens.emplace_back(symbol_of(tok.terminal), std::string(tok.lexeme(input)));
+	}
 
 	return tokens;
 }
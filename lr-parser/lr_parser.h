@@ -3,28 +3,43 @@
 #define __LR_PARSER_H__
 
 #include "framework.h"
+#include "simd_scan.h"
+#include "source_buffer.h"
+#include "string_pool.h"
 
 #include <stdint.h>
 #include <iostream>
 #include <vector>
 #include <string>
+#include <cstring>
 #include <set>
 #include <unordered_map>
 #include <unordered_set>
 #include <regex>
 #include <stack>
 #include <memory>
+#include <memory_resource>
 #include <any>
 #include <functional>
 #include <sstream>
 #include <iomanip>
+#include <string_view>
+#include <algorithm>
+#include <thread>
+#include <chrono>
+#include <atomic>
+#include <mutex>
+#include <stdexcept>
 
 //typedef uint64_t item_set_id_t;
 using item_set_id_t = int32_t;
 using item_id_t = uint64_t;
 using parser_action_value_t = int32_t;
 using production_id_t = parser_action_value_t;
+using terminal_id_t = int32_t;
 constexpr production_id_t AUGMENTED_GRAMMAR_PROD_ID = 0;
+constexpr terminal_id_t END_MARKER_TERMINAL_ID = 0;
+constexpr terminal_id_t INVALID_TERMINAL_ID = -1;
 
 static_assert(std::is_same_v < parser_action_value_t, production_id_t>, "action_value_t and production_id_t must be the same type");
 
@@ -124,18 +139,28 @@ namespace parse {
 		}
 	};
 
-	struct production_t {
+	/* Associativity of a terminal with declared precedence */
+	enum class associativity_t {
+		LEFT,
+		RIGHT,
+		NONASSOC
+	};
+
+	/* Precedence declared for a terminal with %left, %right or %nonassoc; higher levels bind tighter */
+	struct precedence_t {
+		int level = 0;                                      // 0 if no precedence was declared
+		associativity_t assoc = associativity_t::NONASSOC;  // How operators of the same level group
+	};
 
-		static production_id_t prod_id_size;
+	struct production_t {
 
 		symbol_t left;
 		std::vector<symbol_t> right;
-		production_id_t id;
-
-		production_t(const symbol_t& l, const std::vector<symbol_t>& r)
-			: left(l), right(r) {
+		production_id_t id;          // Unique within the grammar the production belongs to
+		symbol_t precedence_symbol;  // Terminal given with %prec, empty name if none
 
-			id = production_t::prod_id_size++;
+		production_t(const symbol_t& l, const std::vector<symbol_t>& r, production_id_t prod_id)
+			: left(l), right(r), id(prod_id) {
 		}
 
 
@@ -411,58 +436,75 @@ namespace parse {
 		}
 	};
 
+	/* Estimated heap bytes of a hash set: one node per element and the bucket array */
+	template <typename set_t>
+	size_t hash_set_bytes(const set_t& set) {
+		return set.size() * (sizeof(typename set_t::value_type) + 2 * sizeof(void*)) + set.bucket_count() * sizeof(void*);
+	}
+
+	/* Estimated heap bytes of a vector: its capacity */
+	template <typename vector_t>
+	size_t vector_bytes(const vector_t& vector) {
+		return vector.capacity() * sizeof(typename vector_t::value_type);
+	}
+
 	/*
 	 * Class representing a set of LR(0) items used in parser construction
 	 *
 	 * An LR(0) item set contains multiple LR(0) items that share the same core (production and dot position)
 	 * and is used to represent states in the LR(0) automaton during parser construction.
+	 *
+	 * Items are kept in a vector sorted by item ID, one per core, next to a vector of their IDs:
+	 * lookups are binary searches over the IDs and two sets are equal if their IDs compare equal
+	 * byte for byte. Items are added through add_items(), which keeps both vectors in step.
 	 */
 	class lr0_item_set {
 	public:
-		std::unordered_set<lr0_item_t, lr0_item_hasher> items;  // Collection of LR(0) items
-		item_set_id_t id;                                        // Unique identifier for this item set
+		std::vector<lr0_item_t> items;  // Collection of LR(0) items, sorted by ID
+		item_set_id_t id;               // Unique identifier for this item set
+
+	private:
+		std::vector<item_id_t> ids;     // ID of each item, in the order of items
 
+	public:
 		/* Constructor that optionally sets the item set ID */
 		lr0_item_set(int set_id = -1) : id(set_id) {}
 
 		/* Copy constructor */
-		lr0_item_set(const lr0_item_set& other) : id(other.id), items(other.items) {}
+		lr0_item_set(const lr0_item_set& other) : items(other.items), id(other.id), ids(other.ids) {}
 
 		/* Equality comparison based on the core items (production ID and dot position) */
 		bool operator==(const lr0_item_set& other) const {
-			std::set<std::pair<production_id_t, int>> core_items, other_core_items;
-
-			for (const lr0_item_t& item : items) {
-				core_items.insert({ item.product->id, item.dot_pos });
-			}
-
-			for (const lr0_item_t& item : other.items) {
-				other_core_items.insert({ item.product->id, item.dot_pos });
-			}
+			return ids.size() == other.ids.size() &&
+				(ids.empty() || std::memcmp(ids.data(), other.ids.data(), ids.size() * sizeof(item_id_t)) == 0);
+		}
 
-			return core_items == other_core_items;
+		/* Returns the position of the item with the given ID in items, items.size() if there is none */
+		size_t index_of(item_id_t item_id) const {
+			auto it = std::lower_bound(ids.begin(), ids.end(), item_id);
+			return it != ids.end() && *it == item_id ? static_cast<size_t>(it - ids.begin()) : items.size();
 		}
 
-		/* Adds a single LR(0) item to the set */
+		/* Adds a single LR(0) item to the set, unless it has an item with the same core */
 		void add_items(const lr0_item_t& item) {
-			this->items.insert(item);
+			auto it = std::lower_bound(ids.begin(), ids.end(), item.id);
+			if (it != ids.end() && *it == item.id)
+				return;
+			items.insert(items.begin() + (it - ids.begin()), item);
+			ids.insert(it, item.id);
 		}
 
 		/* Adds all items from another LR(0) item set */
 		void add_items(const lr0_item_set& items) {
 			for (const auto& i : items.items) {
-				this->items.insert(i);
+				add_items(i);
 			}
 		}
 
 		/* Finds an item in the set based on its core (production ID and dot position) */
 		const lr0_item_t* find_item(const lr0_item_t& core) const {
-			for (auto& item : items) {
-				if (item.product->id == core.product->id && item.dot_pos == core.dot_pos) {
-					return &item;
-				}
-			}
-			return nullptr;
+			size_t index = index_of(core.id);
+			return index < items.size() ? &items[index] : nullptr;
 		}
 
 		/* Checks if the item set is empty */
@@ -470,16 +512,21 @@ namespace parse {
 			return this->items.empty();
 		}
 
-		/* Returns a reference to the underlying unordered set of items */
-		std::unordered_set<lr0_item_t, lr0_item_hasher>& get_items() {
-			return items;
+		/* Returns the estimated heap bytes held by the item set */
+		size_t memory_size() const {
+			return vector_bytes(items) + vector_bytes(ids);
 		}
 
-		/* Returns a const reference to the underlying unordered set of items */
-		const std::unordered_set<lr0_item_t, lr0_item_hasher>& get_items() const {
+		/* Returns the items, sorted by ID */
+		const std::vector<lr0_item_t>& get_items() const {
 			return items;
 		}
 
+		/* Returns the IDs of the items in ascending order */
+		const std::vector<item_id_t>& get_ids() const {
+			return ids;
+		}
+
 		/* Output stream operator for printing the item set */
 		friend std::ostream& operator<<(std::ostream& os, const lr0_item_set& item_set) {
 			os << "Item Set ID: " << item_set.id << std::endl;
@@ -516,39 +563,53 @@ namespace parse {
 	 *
 	 * An LALR(1) item set extends LR(0) item sets with lookahead information,
 	 * which is crucial for resolving parsing conflicts in LALR(1) parsers.
+	 *
+	 * Laid out like lr0_item_set. The lookaheads of an item can be changed in place, through
+	 * add_lookaheads_for_item() or the non-const find_item_by_id(); its production and dot
+	 * position, which make up the ID the items are sorted by, cannot.
 	 */
 	class lalr1_item_set {
 	public:
-		std::unordered_set<lalr1_item_t, lalr1_item_hasher> items;  // Collection of LALR(1) items
-		item_set_id_t id;                                            // Unique identifier for this item set
+		std::vector<lalr1_item_t> items;  // Collection of LALR(1) items, sorted by ID
+		item_set_id_t id;                 // Unique identifier for this item set
 
+	private:
+		std::vector<item_id_t> ids;       // ID of each item, in the order of items
+
+	public:
 		/* Constructor that optionally sets the item set ID */
 		lalr1_item_set(int set_id = -1) : id(set_id) {}
 
 		/* Copy constructor */
-		lalr1_item_set(const lalr1_item_set& other) : id(other.id), items(other.items) {}
+		lalr1_item_set(const lalr1_item_set& other) : items(other.items), id(other.id), ids(other.ids) {}
 
 		/* Equality comparison based on the core items (production ID and dot position) */
 		bool operator==(const lalr1_item_set& other) const {
-			std::set<std::pair<production_id_t, int>> core_items, other_core_items;
-			for (const lalr1_item_t& item : items) {
-				core_items.insert({ item.product->id, item.dot_pos });
-			}
-			for (const lalr1_item_t& item : other.items) {
-				other_core_items.insert({ item.product->id, item.dot_pos });
-			}
-			return core_items == other_core_items;
+			return ids.size() == other.ids.size() &&
+				(ids.empty() || std::memcmp(ids.data(), other.ids.data(), ids.size() * sizeof(item_id_t)) == 0);
+		}
+
+		/* Returns the position of the item with the given ID in items, items.size() if there is none */
+		size_t index_of(item_id_t item_id) const {
+			auto it = std::lower_bound(ids.begin(), ids.end(), item_id);
+			return it != ids.end() && *it == item_id ? static_cast<size_t>(it - ids.begin()) : items.size();
 		}
 
-		/* Adds a single LALR(1) item to the set */
+		/* Adds a single LALR(1) item to the set; an item with the same core gets its lookaheads */
 		void add_items(const lalr1_item_t& item) {
-			this->items.insert(item);
+			auto it = std::lower_bound(ids.begin(), ids.end(), item.id);
+			if (it != ids.end() && *it == item.id) {
+				items[it - ids.begin()].add_lookaheads(item.lookaheads);
+				return;
+			}
+			items.insert(items.begin() + (it - ids.begin()), item);
+			ids.insert(it, item.id);
 		}
 
 		/* Adds all items from another LALR(1) item set */
 		void add_items(const lalr1_item_set& items) {
 			for (const auto& i : items.items) {
-				this->items.insert(i);
+				add_items(i);
 			}
 		}
 
@@ -566,52 +627,45 @@ namespace parse {
 			return result;
 		}
 
-		/* Returns a reference to the underlying unordered set of items */
-		std::unordered_set<lalr1_item_t, lalr1_item_hasher>& get_items() {
+		/* Returns the items, sorted by ID; only their lookaheads may be changed */
+		std::vector<lalr1_item_t>& get_items() {
 			return items;
 		}
 
+		/* Returns the items, sorted by ID */
+		const std::vector<lalr1_item_t>& get_items() const {
+			return items;
+		}
+
+		/* Returns the IDs of the items in ascending order */
+		const std::vector<item_id_t>& get_ids() const {
+			return ids;
+		}
+
 		/*
 		 * Adds lookahead symbols to a specific item identified by its ID
 		 * Returns true if any new lookaheads were added
 		 */
 		bool add_lookaheads_for_item(const item_id_t id, const std::unordered_set<symbol_t, symbol_hasher>& las) {
-			const lalr1_item_t* original_i = find_item_by_id(id);
-
-			if (original_i == nullptr)
-				return false;
-
-			size_t before_size = original_i->lookaheads.size();
-			lalr1_item_t modified_i = lalr1_item_t(*original_i);
-			del_items(modified_i);
-
-			// Copy the original item and add new lookaheads
-			modified_i.add_lookaheads(las);
-			add_items(modified_i);
-
-			if (modified_i.lookaheads.size() != before_size)
-				return true;
-
-			return false;
+			lalr1_item_t* item = find_item_by_id(id);
+			return item != nullptr && item->add_lookaheads(las);
 		}
 
 		/* Finds an item in the set based on its core (production ID and dot position) */
 		const lalr1_item_t* find_item(const lr0_item_t& core) const {
-			for (const auto& item : items) {
-				if (item.product->id == core.product->id && item.dot_pos == core.dot_pos) {
-					return &item;
-				}
-			}
-			return nullptr;
+			return find_item_by_id(core.id);
 		}
 
 		/* Finds an item in the set based on its unique ID */
 		const lalr1_item_t* find_item_by_id(const item_id_t& id) const {
-			for (const auto& item : items) {
-				if (id == item.id)
-					return &item;
-			}
-			return nullptr;
+			size_t index = index_of(id);
+			return index < items.size() ? &items[index] : nullptr;
+		}
+
+		/* Finds an item in the set based on its unique ID, for changing its lookaheads */
+		lalr1_item_t* find_item_by_id(const item_id_t& id) {
+			size_t index = index_of(id);
+			return index < items.size() ? &items[index] : nullptr;
 		}
 
 		/* Checks if the item set is empty */
@@ -619,6 +673,14 @@ namespace parse {
 			return this->items.empty();
 		}
 
+		/* Returns the estimated heap bytes held by the item set, lookahead sets included */
+		size_t memory_size() const {
+			size_t bytes = vector_bytes(items) + vector_bytes(ids);
+			for (const auto& item : items)
+				bytes += hash_set_bytes(item.lookaheads);
+			return bytes;
+		}
+
 		/* Output stream operator for printing the item set */
 		friend std::ostream& operator<<(std::ostream& os, const lalr1_item_set& item_set) {
 			os << "Item Set ID: " << item_set.id << std::endl;
@@ -638,28 +700,15 @@ namespace parse {
 		}
 
 	private:
-		/*
-		 * Removes a specific item from the set
-		 * First attempts direct hash-based removal, then falls back to content-based search
-		 */
+		/* Removes the item with the same core as target from the set */
 		bool remove_item(const lalr1_item_t& target) {
-			// First try direct removal (if hash is correct)
-			if (items.erase(target) > 0) return true;
-
-			// If that fails, search for item with matching content
-			auto it = std::find_if(items.begin(), items.end(), [&](const auto& item) {
-				return item.product->id == target.product->id &&
-					item.dot_pos == target.dot_pos &&
-					item.id == target.id &&
-					item.lookaheads == target.lookaheads; // Direct set comparison
-				});
-
-			if (it != items.end()) {
-				items.erase(it);
-				return true;
-			}
+			size_t index = index_of(target.id);
+			if (index == items.size())
+				return false;
 
-			return false;
+			items.erase(items.begin() + index);
+			ids.erase(ids.begin() + index);
+			return true;
 		}
 	};
 
@@ -677,6 +726,606 @@ namespace parse {
 		}
 	};
 
+	class lalr_grammar;
+
+	/*
+	 * Immutable snapshot of a grammar's productions in flat arrays
+	 *
+	 * Symbols are numbered densely, terminals first, each group sorted by name. Productions are
+	 * numbered densely and grouped by left-hand side, so the productions of a non-terminal form
+	 * the range [production_begin(A), production_end(A)). All right-hand sides are stored back
+	 * to back in one array, each followed by END_OF_RHS, which makes an LR(0) item a plain
+	 * integer: the index of the symbol after its dot. Reading the next symbol is one load and
+	 * moving the dot over it adds one. Epsilon productions have an empty right-hand side.
+	 */
+	class frozen_grammar {
+	public:
+		using symbol_index_t = uint32_t;
+		using item_index_t = uint32_t;
+		static constexpr uint32_t END_OF_RHS = 0xFFFFFFFFu;     // Follows each right-hand side
+		static constexpr uint32_t INVALID_INDEX = 0xFFFFFFFFu;  // Symbol or production not in the grammar
+
+	private:
+		std::vector<symbol_t> symbols;                                           // Symbol of each index
+		std::unordered_map<symbol_t, symbol_index_t, symbol_hasher> symbol_indices;  // Index of each symbol
+		uint32_t terminals = 0;                                                  // Number of terminals
+		std::vector<uint32_t> left_begin;       // First production of each non-terminal (index - terminals), plus the end
+		std::vector<symbol_index_t> left;       // Left-hand side of each production
+		std::vector<uint32_t> rhs_offset;       // Start of each production's right-hand side in rhs
+		std::vector<uint32_t> rhs_length;       // Length of each production's right-hand side
+		std::vector<symbol_index_t> rhs;        // Right-hand sides, each followed by END_OF_RHS
+		std::vector<uint32_t> item_production;  // Production each position of rhs belongs to
+		std::vector<std::shared_ptr<production_t>> sources;  // Production each index was frozen from
+		production_id_t first_id = 0;           // Smallest production ID
+		std::vector<uint32_t> index_of_id;      // Production index by ID - first_id, INVALID_INDEX for gaps
+
+	public:
+		/* Takes a snapshot of the productions of a grammar */
+		explicit frozen_grammar(const lalr_grammar& grammar);
+
+		size_t symbol_count() const {
+			return symbols.size();
+		}
+
+		size_t terminal_count() const {
+			return terminals;
+		}
+
+		bool is_terminal(symbol_index_t s) const {
+			return s < terminals;
+		}
+
+		const symbol_t& symbol(symbol_index_t s) const {
+			return symbols[s];
+		}
+
+		/* Returns the index of a symbol, or INVALID_INDEX if the grammar does not use it */
+		symbol_index_t index_of(const symbol_t& sym) const {
+			auto it = symbol_indices.find(sym);
+			return it != symbol_indices.end() ? it->second : INVALID_INDEX;
+		}
+
+		size_t production_count() const {
+			return left.size();
+		}
+
+		/* Returns the first production of a non-terminal */
+		uint32_t production_begin(symbol_index_t non_terminal) const {
+			return left_begin[non_terminal - terminals];
+		}
+
+		/* Returns one past the last production of a non-terminal */
+		uint32_t production_end(symbol_index_t non_terminal) const {
+			return left_begin[non_terminal - terminals + 1];
+		}
+
+		symbol_index_t left_of(uint32_t p) const {
+			return left[p];
+		}
+
+		uint32_t rhs_length_of(uint32_t p) const {
+			return rhs_length[p];
+		}
+
+		/* Returns the number of items, which are numbered from 0 */
+		size_t item_count() const {
+			return rhs.size();
+		}
+
+		/* Returns the item with the dot at the start of a production */
+		item_index_t first_item(uint32_t p) const {
+			return rhs_offset[p];
+		}
+
+		/* Returns the symbol after the dot of an item, END_OF_RHS if the item is complete */
+		symbol_index_t next_symbol(item_index_t item) const {
+			return rhs[item];
+		}
+
+		uint32_t production_of(item_index_t item) const {
+			return item_production[item];
+		}
+
+		int dot_of(item_index_t item) const {
+			return static_cast<int>(item - rhs_offset[item_production[item]]);
+		}
+
+		/* Returns the production a production index was frozen from */
+		const std::shared_ptr<production_t>& production(uint32_t p) const {
+			return sources[p];
+		}
+
+		/* Returns the index of a production ID, or INVALID_INDEX if the grammar has no such production */
+		uint32_t index_of_production(production_id_t id) const {
+			if (id < first_id || static_cast<size_t>(id - first_id) >= index_of_id.size())
+				return INVALID_INDEX;
+			return index_of_id[id - first_id];
+		}
+
+		/* Converts an item to the shared_ptr based form used by the LALR(1) item sets */
+		lr0_item_t to_lr0_item(item_index_t item) const {
+			return lr0_item_t(sources[item_production[item]], dot_of(item));
+		}
+
+		/* Returns the item_id_t of an item, as lr0_item_t numbers it */
+		item_id_t item_id(item_index_t item) const {
+			return (static_cast<item_id_t>(sources[item_production[item]]->id) << 32) | static_cast<item_id_t>(dot_of(item));
+		}
+
+		/* Returns the index of an item of the shared_ptr based form, INVALID_INDEX if its production was not frozen */
+		item_index_t item_of(const lr0_item_t& item) const {
+			uint32_t p = index_of_production(item.product->id);
+			return p != INVALID_INDEX ? first_item(p) + item.dot_pos : INVALID_INDEX;
+		}
+
+		/* Replaces items by the LR(0) closure of kernel */
+		void lr0_closure(const std::vector<item_index_t>& kernel, std::vector<item_index_t>& items) const;
+	};
+
+	/*
+	 * Scratch memory of the LALR(1) closures of one build
+	 *
+	 * Closures run on the integer items of a frozen_grammar. A lookahead set is a row of bits
+	 * with one column per terminal of the frozen grammar, followed by the end marker and the
+	 * lookahead sentinel unless the grammar has terminals of those names; the FIRST sets of the
+	 * non-terminals are rows of the same width. All of it is carved out of one monotonic buffer:
+	 * the rows and worklists of a closure are cleared and reused by the next one, and the whole
+	 * buffer is released at once when the arena is destroyed, which build() does when it ends.
+	 */
+	class lalr1_closure_arena {
+	public:
+		using item_index_t = frozen_grammar::item_index_t;
+		using word_t = uint64_t;
+
+	private:
+		std::shared_ptr<const frozen_grammar> grammar;
+		std::pmr::monotonic_buffer_resource resource;
+		size_t allocated = 0;                  // Bytes handed out by allocate()
+		size_t words = 0;                      // Words of a lookahead row
+		size_t columns = 0;                    // Lookahead columns in use
+		std::vector<symbol_t> column_symbols;  // Symbol of each column
+		size_t end_marker = 0;                 // Column of the end marker
+		size_t sentinel = 0;                   // Column of the lookahead sentinel
+
+		word_t* first_rows = nullptr;          // FIRST set of each non-terminal, epsilon left out
+		bool* nullable = nullptr;              // Whether each non-terminal derives epsilon
+		word_t* rows = nullptr;                // Lookaheads of each item of the current closure
+		word_t* first_after = nullptr;         // FIRST of what follows the non-terminal being expanded
+		bool* in_closure = nullptr;            // Whether each item is in the current closure
+		bool* queued = nullptr;                // Whether each item is on the worklist
+		item_index_t* items = nullptr;         // Items of the current closure, kernel first
+		size_t item_count = 0;
+		item_index_t* worklist = nullptr;      // Items whose lookaheads have not reached their closure yet
+		size_t pending = 0;
+
+		/* Returns n zeroed objects carved out of the buffer */
+		template <typename T>
+		T* allocate(size_t n) {
+			allocated += n * sizeof(T);
+			T* p = static_cast<T*>(resource.allocate(n * sizeof(T), alignof(T)));
+			std::fill(p, p + n, T());
+			return p;
+		}
+
+	public:
+		/* Sets up the rows for the frozen snapshot of a grammar whose FIRST sets are computed */
+		lalr1_closure_arena(const lalr_grammar& owner, std::shared_ptr<const frozen_grammar> grammar);
+
+		lalr1_closure_arena(const lalr1_closure_arena&) = delete;
+		lalr1_closure_arena& operator=(const lalr1_closure_arena&) = delete;
+
+		const frozen_grammar& frozen() const {
+			return *grammar;
+		}
+
+		const std::shared_ptr<const frozen_grammar>& snapshot() const {
+			return grammar;
+		}
+
+		/* Returns the bytes carved out of the buffer so far */
+		size_t bytes() const {
+			return allocated;
+		}
+
+		size_t row_words() const {
+			return words;
+		}
+
+		/* Returns n zeroed lookahead rows that live as long as the arena */
+		word_t* allocate_rows(size_t n) {
+			return allocate<word_t>(n * words);
+		}
+
+		/* Returns the column of a terminal, the end marker or the sentinel; column_count() if it has none */
+		size_t column_of(const symbol_t& sym) const;
+
+		size_t column_count() const {
+			return columns;
+		}
+
+		const symbol_t& column_symbol(size_t column) const {
+			return column_symbols[column];
+		}
+
+		size_t end_marker_column() const {
+			return end_marker;
+		}
+
+		size_t sentinel_column() const {
+			return sentinel;
+		}
+
+		static void set(word_t* row, size_t column) {
+			row[column / 64] |= word_t(1) << (column % 64);
+		}
+
+		static bool test(const word_t* row, size_t column) {
+			return (row[column / 64] >> (column % 64)) & 1;
+		}
+
+		/* Adds the bits of from to to, returns true if to gained any */
+		bool merge(word_t* to, const word_t* from) const {
+			word_t gained = 0;
+			for (size_t w = 0; w < words; w++) {
+				gained |= from[w] & ~to[w];
+				to[w] |= from[w];
+			}
+			return gained != 0;
+		}
+
+		/* Calls f with each column set in a row, in increasing order */
+		template <typename F>
+		void for_each_column(const word_t* row, F f) const {
+			for (size_t w = 0; w < words; w++) {
+				size_t column = w * 64;
+				for (word_t bits = row[w]; bits != 0; bits >>= 1, column++) {
+					if (bits & 1)
+						f(column);
+				}
+			}
+		}
+
+		/* Empties the current closure so the next one can start */
+		void clear();
+
+		/* Adds a kernel item to the current closure, returns its lookahead row to fill in */
+		word_t* add_kernel(item_index_t item);
+
+		/* Closes the items added, returns the number of worklist steps it took */
+		size_t close();
+
+		/* Items of the current closure, kernel first */
+		size_t size() const {
+			return item_count;
+		}
+
+		item_index_t item(size_t k) const {
+			return items[k];
+		}
+
+		const word_t* lookaheads(item_index_t item) const {
+			return rows + item * words;
+		}
+	};
+
+	/*
+	 * Lookahead links one LALR(1) state contributes to the propagation
+	 *
+	 * They depend only on the closure of the state, so a build with keep_lookahead_links set keeps
+	 * them and build(previous) reuses them for a state whose closure an edit of the grammar did
+	 * not change. Successors are named by the symbol of the GOTO, not by a state number, which may
+	 * differ between builds. Symbols are indices into grammar, and the spontaneous lookaheads of
+	 * a successor's kernel item, merged over the kernel items of the state, are a lookahead row
+	 * of a closure arena for grammar: bit t is terminal t, bit terminal_count() the end marker.
+	 */
+	struct state_lookahead_links_t {
+		using symbol_index_t = frozen_grammar::symbol_index_t;
+		using word_t = lalr1_closure_arena::word_t;
+
+		struct propagation_t {
+			item_id_t from;         // Kernel item of the state
+			symbol_index_t symbol;  // Symbol of the GOTO the lookaheads flow along
+			item_id_t to;           // Kernel item of the GOTO state receiving them
+		};
+
+		struct spontaneous_t {
+			symbol_index_t symbol;  // Symbol of the GOTO
+			item_id_t to;           // Kernel item of the GOTO state
+		};
+
+		std::shared_ptr<const frozen_grammar> grammar;  // Grammar the symbols and lookaheads refer to
+		std::vector<propagation_t> propagation;
+		std::vector<spontaneous_t> spontaneous;
+		size_t words = 0;                // Words of a lookahead row
+		std::vector<word_t> lookaheads;  // Lookahead row of each spontaneous link, in their order
+
+		/* Returns the lookahead row of the k-th spontaneous link */
+		const word_t* lookahead_row(size_t k) const {
+			return lookaheads.data() + k * words;
+		}
+
+		/* Returns the estimated heap bytes of the links */
+		size_t memory_size() const {
+			return sizeof(*this) + vector_bytes(propagation) + vector_bytes(spontaneous) + vector_bytes(lookaheads);
+		}
+	};
+
+	/* A conflict found while building the ACTION table, recorded when lalr_grammar::collect_conflicts is set */
+	struct conflict_t {
+		std::string kind;          // "Shift-Shift", "Shift-Reduce" or "Reduce-Reduce"
+		item_set_id_t state = 0;   // State whose ACTION row has the conflict
+		symbol_t symbol;           // Lookahead symbol of the conflicting actions
+		std::string message;       // What build() prints to std::cerr for it otherwise
+	};
+
+	/* Changes made to a grammar by lalr_grammar::normalize() */
+	struct normalize_report_t {
+		std::vector<symbol_t> non_productive;    // Non-terminals removed because they derive no terminal string
+		std::vector<symbol_t> unreachable;       // Non-terminals removed because the start symbol never derives them
+		std::vector<symbol_t> unused_terminals;  // Terminals no production uses any more
+		std::vector<symbol_t> inlined;           // Non-terminals substituted into the productions using them
+		size_t duplicate_productions = 0;        // Duplicate productions merged
+		size_t productions_before = 0;           // Number of productions before normalizing
+		size_t productions_after = 0;            // Number of productions after normalizing
+		std::string note;                        // Why requested inlining was not done, empty otherwise
+
+		/* Returns true if the grammar was changed */
+		bool changed() const {
+			return !non_productive.empty() || !unreachable.empty() || !inlined.empty() || duplicate_productions > 0;
+		}
+
+		/* Converts the report to a string representation */
+		std::string to_string() const {
+			auto names = [](const std::vector<symbol_t>& symbols) {
+				std::string result;
+				for (const auto& sym : symbols)
+					result += " " + sym.name;
+				return result;
+			};
+
+			std::string result = "Productions: " + std::to_string(productions_before) + " -> " + std::to_string(productions_after) + "\n";
+			if (!non_productive.empty())
+				result += "Removed non-productive non-terminals:" + names(non_productive) + "\n";
+			if (!unreachable.empty())
+				result += "Removed unreachable non-terminals:" + names(unreachable) + "\n";
+			if (!unused_terminals.empty())
+				result += "Unused terminals:" + names(unused_terminals) + "\n";
+			if (duplicate_productions > 0)
+				result += "Merged duplicate productions: " + std::to_string(duplicate_productions) + "\n";
+			if (!inlined.empty())
+				result += "Inlined non-terminals:" + names(inlined) + "\n";
+			if (!note.empty())
+				result += note + "\n";
+			return result;
+		}
+	};
+
+	/*
+	 * What the last lalr_grammar::build() did, for profiling table construction
+	 *
+	 * Phases are the construction steps in the order they started; a phase running inside another
+	 * one has a greater depth. Counters accumulate over the steps called since the statistics were
+	 * reset, which build() and build(previous) do first. Peak memory is an estimate of the heap
+	 * bytes of the item sets (see their memory_size()), the closure arena, the lookahead links
+	 * and propagation edges, and the tables, taken at the points where most of them are alive:
+	 * after the LR(0) automaton is built, once the lookaheads are determined and propagated, and
+	 * after the ACTION table is built.
+	 */
+	struct build_stats_t {
+		using clock_type = std::chrono::steady_clock;
+
+		struct phase_t {
+			std::string name;
+			size_t depth = 0;      // Number of enclosing phases
+			double start_ms = 0;   // Start, relative to the reset of the statistics
+			double wall_ms = 0;    // Wall time
+		};
+
+		/* Records a phase from construction to destruction */
+		class scoped_phase {
+		private:
+			build_stats_t& stats;
+			size_t index;
+			clock_type::time_point start;
+
+		public:
+			scoped_phase(build_stats_t& stats, const char* name) : stats(stats), index(stats.phases.size()), start(clock_type::now()) {
+				stats.phases.push_back({ name, stats.open_phases++, std::chrono::duration<double, std::milli>(start - stats.origin).count(), 0 });
+			}
+
+			~scoped_phase() {
+				stats.phases[index].wall_ms = std::chrono::duration<double, std::milli>(clock_type::now() - start).count();
+				stats.open_phases--;
+			}
+
+			scoped_phase(const scoped_phase&) = delete;
+			scoped_phase& operator=(const scoped_phase&) = delete;
+		};
+
+		clock_type::time_point origin = clock_type::now();  // When the statistics were reset
+		size_t open_phases = 0;                              // Phases currently running
+		std::vector<phase_t> phases;
+
+		size_t first_set_passes = 0;         // Passes of comp_first_sets() over the productions until no FIRST set grew
+		size_t closure_calls = 0;            // LALR(1) closures computed
+		size_t closure_steps = 0;            // Items taken off the worklists of those closures, summed
+		size_t lr0_closures = 0;             // LR(0) closures computed while building the automaton
+		size_t links_determined = 0;         // States whose lookahead links were computed
+		size_t links_reused = 0;             // States whose lookahead links were taken over from a previous build
+		size_t propagation_edges = 0;        // Lookahead propagation links between kernel items
+		size_t propagation_steps = 0;        // Kernel items taken off the propagation worklist
+		size_t rows_reused = 0;              // ACTION rows taken over from a previous build
+
+		size_t states = 0;                   // LALR(1) states
+		size_t kernel_items = 0;             // Kernel items of all states
+		size_t closure_items = 0;            // LR(0) items of all states, closures included
+		size_t lookaheads = 0;               // Lookaheads of all kernel items
+		size_t action_entries = 0;           // Entries of the ACTION table
+		size_t goto_entries = 0;             // Entries of the GOTO table
+
+		size_t arena_bytes = 0;              // Bytes carved out of the closure arena
+		size_t link_bytes = 0;               // Estimated bytes of the lookahead links and propagation edges alive at once, at most
+		size_t peak_bytes = 0;               // Estimated bytes of the construction's data alive at once, at most
+
+		/* Records the bytes alive at a point of the construction */
+		void note_bytes(size_t bytes) {
+			peak_bytes = std::max(peak_bytes, bytes);
+		}
+
+		/* Returns the wall time of the first phase with the given name, 0 if there is none */
+		double phase_ms(const std::string& name) const {
+			for (const auto& phase : phases) {
+				if (phase.name == name)
+					return phase.wall_ms;
+			}
+			return 0;
+		}
+
+		/* Converts the statistics to a string representation */
+		std::string to_string() const {
+			std::ostringstream out;
+			out << std::fixed << std::setprecision(3);
+			for (const auto& phase : phases)
+				out << std::string(2 * phase.depth, ' ') << std::left << std::setw(32 - 2 * phase.depth) << phase.name << std::right << std::setw(12) << phase.wall_ms << " ms\n";
+
+			out << "States: " << states << ", kernel items: " << kernel_items << ", closure items: " << closure_items
+				<< ", kernel lookaheads: " << lookaheads << "\n"
+				<< "ACTION entries: " << action_entries << ", GOTO entries: " << goto_entries << "\n"
+				<< "FIRST set passes: " << first_set_passes << "\n"
+				<< "LR(0) closures: " << lr0_closures << "\n"
+				<< "LALR(1) closures: " << closure_calls << " (" << closure_steps << " worklist steps)\n"
+				<< "Lookahead links: " << links_determined << " states determined, " << links_reused << " reused\n"
+				<< "Propagation: " << propagation_edges << " edges, " << propagation_steps << " worklist steps\n";
+			if (rows_reused > 0)
+				out << "ACTION rows reused: " << rows_reused << "\n";
+			out << "Peak memory: " << (peak_bytes + 1023) / 1024 << " KiB (closure arena "
+				<< (arena_bytes + 1023) / 1024 << " KiB, lookahead links " << (link_bytes + 1023) / 1024 << " KiB, estimated)\n";
+			return out.str();
+		}
+
+		/*
+		 * Converts the phases to the Chrome trace event format (chrome://tracing, Perfetto)
+		 * The counters are attached as arguments of the first phase.
+		 */
+		std::string to_chrome_trace() const {
+			std::ostringstream out;
+			out << std::fixed << std::setprecision(3) << "{\"traceEvents\": [";
+			for (size_t i = 0; i < phases.size(); i++) {
+				out << (i == 0 ? "\n" : ",\n") << "  {\"name\": \"" << phases[i].name << "\", \"cat\": \"build\", \"ph\": \"X\", \"pid\": 1, \"tid\": 1"
+					<< ", \"ts\": " << phases[i].start_ms * 1000 << ", \"dur\": " << phases[i].wall_ms * 1000;
+				if (i == 0) {
+					out << ", \"args\": {\"states\": " << states << ", \"kernel_items\": " << kernel_items
+						<< ", \"closure_items\": " << closure_items << ", \"lookaheads\": " << lookaheads
+						<< ", \"action_entries\": " << action_entries << ", \"goto_entries\": " << goto_entries
+						<< ", \"first_set_passes\": " << first_set_passes << ", \"lr0_closures\": " << lr0_closures
+						<< ", \"closure_calls\": " << closure_calls << ", \"closure_steps\": " << closure_steps
+						<< ", \"links_determined\": " << links_determined << ", \"links_reused\": " << links_reused
+						<< ", \"propagation_edges\": " << propagation_edges << ", \"propagation_steps\": " << propagation_steps
+						<< ", \"rows_reused\": " << rows_reused << ", \"arena_bytes\": " << arena_bytes
+						<< ", \"link_bytes\": " << link_bytes << ", \"peak_bytes\": " << peak_bytes << "}";
+				}
+				out << "}";
+			}
+			out << "\n], \"displayTimeUnit\": \"ms\"}\n";
+			return out.str();
+		}
+	};
+
+	/*
+	 * Size and shape of the tables of a built grammar, see lalr_grammar::footprint()
+	 *
+	 * Table bytes are estimated for three representations with 4-byte cells:
+	 * - hash maps: the ACTION and GOTO tables as this library keeps them (hash nodes and
+	 *   bucket arrays; symbol names longer than the small string buffer are not counted);
+	 * - dense: a states x terminals ACTION array and a states x non-terminals GOTO array;
+	 * - compressed: identical ACTION rows shared, the most frequent reduction of each row made
+	 *   its default, the rest packed into one array by row displacement with a check array;
+	 *   GOTO columns packed the same way, each with its most frequent target as default.
+	 */
+	struct table_footprint_t {
+		struct production_states_t {
+			production_id_t id;
+			std::string production;  // Text of the production
+			size_t states;           // States with an item of the production in their kernel
+		};
+
+		size_t states = 0;
+		size_t terminals = 0;                 // Columns of the ACTION table, end marker included
+		size_t non_terminals = 0;             // Columns of the GOTO table
+		size_t productions = 0;
+		size_t kernel_items = 0;              // Kernel items of all states
+		size_t closure_items = 0;             // LR(0) items of all states, closures included
+
+		size_t action_entries = 0;            // Non-empty ACTION entries
+		size_t shift_entries = 0;
+		size_t reduce_entries = 0;            // Reductions and the accept entry
+		size_t error_entries = 0;             // Entries made errors by %nonassoc
+		size_t goto_entries = 0;              // GOTO entries on non-terminals
+		double action_density = 0;            // action_entries / (states * terminals)
+		double goto_density = 0;              // goto_entries / (states * non_terminals)
+		size_t distinct_action_rows = 0;
+		size_t distinct_goto_rows = 0;
+		size_t default_reducible_states = 0;  // States whose only action is one reduction, whatever the lookahead
+
+		size_t hash_map_bytes = 0;
+		size_t dense_bytes = 0;
+		size_t compressed_bytes = 0;
+
+		std::vector<production_states_t> states_by_production;  // Productions by the states they appear in, most first
+
+		/* Converts the footprint to a report listing the top productions by states */
+		std::string to_string(size_t top = 10) const {
+			auto kib = [](size_t bytes) { return std::to_string((bytes + 1023) / 1024) + " KiB"; };
+			std::ostringstream out;
+			out << std::fixed << std::setprecision(1)
+				<< "States: " << states << ", terminals: " << terminals << ", non-terminals: " << non_terminals
+				<< ", productions: " << productions << "\n"
+				<< "Kernel items: " << kernel_items << ", closure items: " << closure_items << "\n"
+				<< "ACTION entries: " << action_entries << " (" << shift_entries << " shift, " << reduce_entries << " reduce, "
+				<< error_entries << " error), density " << 100 * action_density << "%, distinct rows " << distinct_action_rows << "\n"
+				<< "GOTO entries: " << goto_entries << ", density " << 100 * goto_density << "%, distinct rows " << distinct_goto_rows << "\n"
+				<< "Default-reducible states: " << default_reducible_states << "\n"
+				<< "Table bytes: hash maps " << kib(hash_map_bytes) << ", dense " << kib(dense_bytes)
+				<< ", compressed " << kib(compressed_bytes) << "\n";
+
+			out << "Productions in the most states:\n";
+			for (size_t i = 0; i < top && i < states_by_production.size(); i++)
+				out << "  " << std::setw(8) << states_by_production[i].states << "  " << states_by_production[i].production << "\n";
+			return out.str();
+		}
+	};
+
+	/*
+	 * How often the parser visited each LALR(1) state, for lalr_grammar::renumber_states()
+	 *
+	 * States are named by their kernel items rather than by number, so a profile collected
+	 * with one build still applies after the grammar was edited and rebuilt; states whose
+	 * kernel is not in the profile count as never visited. A profile is usually made from
+	 * parser_counts_t::state_visits of real traffic or a benchmark corpus, and saved as a
+	 * text file of "<visits> TAB <kernel>" lines.
+	 */
+	struct state_profile_t {
+		std::unordered_map<std::string, uint64_t> visits;  // Visits by kernel, see kernel_of()
+
+		/* Returns the kernel of a state as used in profiles, e.g. "Expr -> Expr . + Term | Term -> Term . * Factor" */
+		static std::string kernel_of(const lalr1_item_set& state);
+
+		/* Returns the visits of a state, 0 if it is not in the profile */
+		uint64_t visits_of(const lalr1_item_set& state) const {
+			auto it = visits.find(kernel_of(state));
+			return it != visits.end() ? it->second : 0;
+		}
+
+		/* Adds visits counted by state number for the states of a built grammar */
+		void add_visits(const lalr_grammar& grammar, const std::vector<uint64_t>& state_visits);
+
+		/* Writes the profile to a file, most visited states first. Throws std::runtime_error if it cannot be written */
+		void save(const std::string& filename) const;
+
+		/* Reads a profile written by save(). Throws std::runtime_error if the file cannot be read or is malformed */
+		static state_profile_t load(const std::string& filename);
+	};
+
 	/*
  * Main class representing an LALR(1) grammar and its associated parsing tables
  *
@@ -697,12 +1346,22 @@ namespace parse {
 		std::unordered_map<symbol_t, std::vector<std::shared_ptr<production_t>>, symbol_hasher> productions;  // Productions organized by left-hand side
 		std::unordered_set<symbol_t, symbol_hasher> terminals;     // Set of terminal symbols
 		std::unordered_set<symbol_t, symbol_hasher> non_terminals; // Set of non-terminal symbols
+		std::unordered_map<symbol_t, precedence_t, symbol_hasher> precedences;  // Declared precedence of terminals
 
 		// Computed sets and tables
 		std::unordered_map<symbol_t, std::unordered_set<symbol_t, symbol_hasher>, symbol_hasher> first_sets;  // FIRST sets for symbols
 		std::vector<std::shared_ptr<lalr1_item_set>> lalr1_states;  // LALR(1) states
 		std::unordered_map<item_set_id_t, std::unordered_map<parse::symbol_t, parse::parser_action_t, parse::symbol_hasher>> action_table;  // ACTION table
 		std::unordered_map<std::pair<item_set_id_t, symbol_t>, item_set_id_t, pair_item_set_symbol_hasher> goto_table;  // GOTO table
+		std::shared_ptr<const frozen_grammar> frozen;  // Snapshot of the productions taken by build(), reset when they change
+		std::vector<std::shared_ptr<const state_lookahead_links_t>> lookahead_links;  // Lookahead links of each state if keep_lookahead_links is set, for build(previous)
+		bool keep_lookahead_links = false;  // If set, builds keep lookahead_links so that the grammar can be the previous of build(previous)
+		production_id_t next_production_id = AUGMENTED_GRAMMAR_PROD_ID + 1;  // ID of the next production added
+		build_stats_t stats;  // Statistics of the last build
+		std::shared_ptr<lalr1_closure_arena> arena;  // Scratch memory of the closures while build() runs, null otherwise
+		std::shared_ptr<const state_profile_t> profile;  // Visit counts build() orders the states by, if any
+		bool collect_conflicts = false;  // If set, build() records conflicts in conflicts instead of printing them and throwing
+		std::vector<conflict_t> conflicts;  // Conflicts of the last build if collect_conflicts is set; the first action seen stays in the table
 
 		/* Returns all terminal symbols in the grammar */
 		const std::unordered_set<symbol_t, symbol_hasher>& all_symbols() const {
@@ -710,9 +1369,10 @@ namespace parse {
 		}
 
 		/* Adds a production to the grammar with the given left-hand side and right-hand side symbols */
-		void add_production(const symbol_t& left, const std::vector<symbol_t>& right) {
-			std::shared_ptr<production_t> prod = std::make_shared<production_t>(left, right);
+		std::shared_ptr<production_t> add_production(const symbol_t& left, const std::vector<symbol_t>& right) {
+			std::shared_ptr<production_t> prod = std::make_shared<production_t>(left, right, next_production_id++);
 			productions[left].push_back(prod);
+			frozen.reset();
 			non_terminals.insert(left);
 
 			// Add symbols to appropriate sets
@@ -724,6 +1384,31 @@ namespace parse {
 					non_terminals.insert(sym);
 				}
 			}
+
+			return prod;
+		}
+
+		/* Declares the precedence and associativity of a terminal (used to resolve shift/reduce conflicts) */
+		void set_precedence(const symbol_t& terminal, int level, associativity_t assoc) {
+			precedences[terminal] = { level, assoc };
+		}
+
+		/* Returns the declared precedence of a terminal, level 0 if none */
+		precedence_t precedence_of(const symbol_t& terminal) const {
+			auto it = precedences.find(terminal);
+			return it != precedences.end() ? it->second : precedence_t();
+		}
+
+		/* Returns the precedence of a production: that of its %prec terminal, otherwise of its last terminal */
+		precedence_t precedence_of(const production_t& prod) const {
+			if (!prod.precedence_symbol.name.empty())
+				return precedence_of(prod.precedence_symbol);
+
+			for (auto it = prod.right.rbegin(); it != prod.right.rend(); ++it) {
+				if (it->type == symbol_type_t::TERMINAL)
+					return precedence_of(*it);
+			}
+			return precedence_t();
 		}
 
 		/* Returns all productions for a given symbol (left-hand side) */
@@ -734,8 +1419,13 @@ namespace parse {
 			return empty;
 		}
 
-		/* Finds a production by its unique identifier */
+		/* Finds a production by its unique identifier, in O(1) once build() has frozen the grammar */
 		std::shared_ptr<production_t> get_production_by_id(production_id_t id) const {
+			if (frozen) {
+				uint32_t p = frozen->index_of_production(id);
+				return p != frozen_grammar::INVALID_INDEX ? frozen->production(p) : nullptr;
+			}
+
 			for (const auto& [left, prods] : productions) {
 				for (const auto& prod : prods) {
 					if (prod->id == id) {
@@ -776,25 +1466,127 @@ namespace parse {
 		std::unique_ptr<std::vector<std::shared_ptr<lr0_item_set>>> build_lr0_states();  // Builds LR(0) states
 		void initialize_lalr1_states();  // Initializes LALR(1) states from LR(0) states
 
-		void determine_lookaheads(  // Determines lookaheads for LALR(1) items
-			const item_set_id_t I_id,
-			const symbol_t X,
-			std::unordered_map<std::pair<item_set_id_t, item_id_t>, std::vector<std::pair<item_set_id_t, item_id_t>>, pair_items_state_item_id_hasher>& propagation_graph,
-			std::unordered_map<std::pair<item_set_id_t, item_id_t>, std::unordered_set<parse::symbol_t, parse::symbol_hasher>, pair_items_state_item_id_hasher>& spontaneous_lookaheads
-		);
+		std::shared_ptr<const state_lookahead_links_t> determine_lookaheads(const item_set_id_t I_id);  // Determines the lookahead links of an LALR(1) state
 
-		void set_lalr1_items_lookaheads();  // Sets lookaheads for all LALR(1) items
-		void build_action_table();  // Builds the ACTION table from LALR(1) states
+		void set_lalr1_items_lookaheads();  // Sets lookaheads for all LALR(1) items, computing the links of states without lookahead_links
+		void build_action_table(const std::vector<bool>& prebuilt_rows = {});  // Builds the ACTION table from LALR(1) states, resolving shift/reduce conflicts by precedence; rows marked in prebuilt_rows are kept
+		void report_conflict(const std::string& kind, item_set_id_t state, const symbol_t& symbol, const std::string& message);  // Records a conflict or prints it and throws, depending on collect_conflicts
+		lalr1_closure_arena& closure_arena(std::unique_ptr<lalr1_closure_arena>& local);  // Returns the arena of the running build, or a new one kept in local
 
-		/* Main build function that constructs all components of the LALR(1) parser */
-		void build() {
-			comp_first_sets();
-			initialize_lalr1_states();
-			set_lalr1_items_lookaheads();
-			build_action_table();
+		size_t remove_duplicate_productions();  // Removes productions equal to an earlier one, returns how many
+		void remove_productions_using(const std::unordered_set<symbol_t, symbol_hasher>& symbols);  // Removes the productions of and using the given non-terminals
+		void inline_trivial_non_terminals(size_t max_length, normalize_report_t& report);  // Inlining step of normalize()
+
+		/*
+		 * Removes dead weight from the productions; call before build()
+		 *
+		 * Drops the non-terminals that derive no terminal string and those the start symbol never
+		 * derives, together with every production using them, and merges duplicate productions.
+		 * With inline_trivial set, non-terminals with a single production of at most
+		 * max_inline_length symbols are also substituted into the productions using them. The
+		 * substitution is kept only if a trial build of the result succeeds, so it never introduces
+		 * conflicts; productions containing terminals with declared precedence are never inlined,
+		 * since that could change how conflicts are resolved.
+		 * Throws std::runtime_error if the start symbol derives no terminal string.
+		 */
+		normalize_report_t normalize(bool inline_trivial = false, size_t max_inline_length = 2);
+
+		/* Returns the number of productions */
+		size_t production_count() const {
+			size_t count = 0;
+			for (const auto& entry : productions)
+				count += entry.second.size();
+			return count;
+		}
+
+		/* Returns the estimated heap bytes of the LALR(1) states */
+		size_t lalr1_states_memory_size() const {
+			size_t bytes = 0;
+			for (const auto& state : lalr1_states)
+				bytes += state->memory_size();
+			return bytes;
+		}
+
+		/* Returns the estimated heap bytes of the ACTION and GOTO tables */
+		size_t tables_memory_size() const {
+			size_t bytes = hash_set_bytes(action_table) + hash_set_bytes(goto_table);
+			for (const auto& [state, row] : action_table)
+				bytes += hash_set_bytes(row);
+			return bytes;
+		}
+
+		/* Returns the estimated heap bytes of the lookahead links kept */
+		size_t lookahead_links_memory_size() const {
+			size_t bytes = vector_bytes(lookahead_links);
+			for (const auto& links : lookahead_links) {
+				if (links)
+					bytes += links->memory_size();
+			}
+			return bytes;
 		}
 
-		/* Converts all productions to a string representation */
+		/*
+		 * Gives the closures of a build an arena, released when the scope ends or a conflict throws
+		 * Needs the FIRST sets and the frozen grammar, so it opens after initialize_lalr1_states().
+		 */
+		class arena_scope {
+		private:
+			lalr_grammar& grammar;
+
+		public:
+			explicit arena_scope(lalr_grammar& grammar);
+			~arena_scope();
+
+			arena_scope(const arena_scope&) = delete;
+			arena_scope& operator=(const arena_scope&) = delete;
+		};
+
+		/* Main build function that constructs all components of the LALR(1) parser; see stats for what it did */
+		void build() {
+			stats = build_stats_t();
+			build_stats_t::scoped_phase phase(stats, "build");
+			lookahead_links.clear();
+			comp_first_sets();
+			initialize_lalr1_states();
+			{
+				arena_scope scope(*this);
+				set_lalr1_items_lookaheads();
+				build_action_table();
+			}
+			if (profile)
+				renumber_states(*profile);
+		}
+
+		/*
+		 * Renumbers the states by how often the profile says they are visited, most visited first
+		 *
+		 * State 0, where every parse starts, keeps its number; ties keep their old order, so the
+		 * numbering is stable for a given profile. The ACTION and GOTO entries are re-keyed in
+		 * place, so the hash tables gain no locality; the per-state arrays of lr_parser and
+		 * parser_counters do put hot states together. The tables are the same automaton under
+		 * other state numbers. build() and build(previous) call this when profile is set.
+		 */
+		void renumber_states(const state_profile_t& profile);
+
+		/* Returns the size and shape of the tables; all zero if they are not built */
+		table_footprint_t footprint() const;
+
+		/*
+		 * Builds the tables like build(), reusing the work of a build of an earlier version of the grammar
+		 *
+		 * Meant for editing a grammar and rebuilding it: previous is the grammar before the edit,
+		 * whose build with keep_lookahead_links set succeeded. Productions equal to one of previous (same sides and %prec) take
+		 * over its ID; the others get IDs previous never used. Only the FIRST sets of non-terminals
+		 * deriving a non-terminal whose productions changed are recomputed. The LR(0) automaton is
+		 * rebuilt, which is cheap, but lookahead links are computed only for states whose closure
+		 * expands a changed non-terminal or depends on a changed FIRST set, and the ACTION rows of
+		 * the other states are taken over when their lookaheads came out the same. Falls back to
+		 * build() if previous kept no links, has no complete tables or has another start symbol.
+		 * The tables equal those of build() apart from production IDs.
+		 */
+		void build(const lalr_grammar& previous);
+
+		/* Converts all productions to a string representation */
 		std::string productions_to_string() const {
 			std::string result;
 			for (const auto& sym : productions) {
@@ -1084,84 +1876,404 @@ namespace parse {
 		}
 	};
 
+	/*
+	 * Keyword lookup table based on a perfect hash
+	 *
+	 * Keywords are lexed as identifiers first and then looked up here, so recognizing a
+	 * keyword costs one hash and one string compare no matter how many keywords exist.
+	 * rebuild() searches for a hash seed that maps every keyword to a distinct slot.
+	 */
+	class keyword_table {
+	private:
+		struct slot_t {
+			std::string word;                              // Keyword text, empty for unused slots
+			terminal_id_t terminal = INVALID_TERMINAL_ID;  // Terminal produced by the keyword
+		};
+
+		std::vector<std::pair<std::string, terminal_id_t>> keywords;  // Registered keywords
+		std::vector<slot_t> slots;                                      // Perfect hash table
+		uint32_t seed = 0;                                              // Hash seed used by the table
+		uint32_t mask = 0;                                              // slots.size() - 1
+
+	public:
+		/* Seeded FNV-1a hash used for slot selection */
+		static constexpr uint32_t hash(std::string_view word, uint32_t seed) {
+			uint32_t h = 2166136261u ^ seed;
+			for (char c : word) {
+				h ^= static_cast<unsigned char>(c);
+				h *= 16777619u;
+			}
+			return h ^ (h >> 15);
+		}
+
+		/* Registers a keyword, replacing the terminal of an existing one; call rebuild() afterwards */
+		void add(std::string_view word, terminal_id_t terminal) {
+			for (auto& kw : keywords) {
+				if (kw.first == word) {
+					kw.second = terminal;
+					return;
+				}
+			}
+			keywords.emplace_back(std::string(word), terminal);
+		}
+
+		/* Removes all keywords */
+		void clear() {
+			keywords.clear();
+			slots.clear();
+			seed = 0;
+			mask = 0;
+		}
+
+		/* Returns the number of registered keywords */
+		size_t size() const {
+			return keywords.size();
+		}
+
+		/* Recomputes the perfect hash table for the registered keywords */
+		void rebuild() {
+			size_t table_size = 8;
+			while (table_size < keywords.size() * 2)
+				table_size <<= 1;
+
+			while (true) {
+				for (uint32_t candidate = 0; candidate < 4096; candidate++) {
+					std::vector<slot_t> candidate_slots(table_size);
+					bool collision = false;
+
+					for (const auto& kw : keywords) {
+						slot_t& slot = candidate_slots[hash(kw.first, candidate) & (table_size - 1)];
+						if (slot.terminal != INVALID_TERMINAL_ID) {
+							collision = true;
+							break;
+						}
+						slot.word = kw.first;
+						slot.terminal = kw.second;
+					}
+
+					if (!collision) {
+						slots = std::move(candidate_slots);
+						seed = candidate;
+						mask = static_cast<uint32_t>(table_size - 1);
+						return;
+					}
+				}
+				table_size <<= 1;
+			}
+		}
+
+		/* Returns the terminal of a keyword, or INVALID_TERMINAL_ID if the word is not a keyword */
+		terminal_id_t find(std::string_view word) const {
+			if (slots.empty())
+				return INVALID_TERMINAL_ID;
+			const slot_t& slot = slots[hash(word, seed) & mask];
+			return slot.word == word ? slot.terminal : INVALID_TERMINAL_ID;
+		}
+	};
+
+	/* Line and column (both 1-based) of a byte offset in a source buffer */
+	struct source_position_t {
+		size_t line = 1;
+		size_t column = 1;
+	};
+
+	/*
+	 * Index of line start offsets in a source buffer
+	 *
+	 * The lexer only tracks byte offsets; this index converts an offset to a line/column
+	 * pair with a binary search. It is built on demand with a vectorized newline scan.
+	 */
+	class line_index {
+	private:
+		std::vector<size_t> line_starts;  // Offset of the first byte of every line
+
+	public:
+		/* Indexes the line starts of a source buffer */
+		void build(std::string_view source) {
+			line_starts.clear();
+			line_starts.push_back(0);
+
+			size_t pos = 0;
+			while (true) {
+				pos = simd::find_byte(source.data(), pos, source.size(), '\n');
+				if (pos >= source.size())
+					break;
+				line_starts.push_back(++pos);
+			}
+		}
+
+		/* Drops the index */
+		void clear() {
+			line_starts.clear();
+		}
+
+		/* Returns true if no buffer is indexed */
+		bool empty() const {
+			return line_starts.empty();
+		}
+
+		/* Converts a byte offset to a line/column pair in O(log n) */
+		source_position_t position_of(size_t offset) const {
+			if (line_starts.empty())
+				return { 1, offset + 1 };
+
+			auto it = std::upper_bound(line_starts.begin(), line_starts.end(), offset);
+			size_t line = static_cast<size_t>(it - line_starts.begin());
+			return { line, offset - line_starts[line - 1] + 1 };
+		}
+	};
+
+	/*
+	 * Compact token referencing a span of the caller-owned source buffer
+	 *
+	 * A token stores the lexer terminal ID and the byte range of its lexeme instead of
+	 * copies of the symbol name and the lexeme, so tokenizing does not allocate per token.
+	 * The source buffer must outlive every token taken from it.
+	 */
+	struct token_t {
+		uint64_t offset;         // Byte offset of the lexeme in the source buffer
+		uint32_t length;         // Length of the lexeme in bytes
+		terminal_id_t terminal;  // Terminal ID assigned by the lexer (see lexer::symbol_of)
+		atom_t atom = INVALID_ATOM;  // Atom of the interned lexeme (see lexer::set_string_pool)
+
+		/* Returns the lexeme as a view into the source buffer */
+		std::string_view lexeme(std::string_view source) const {
+			return source.substr(static_cast<size_t>(offset), length);
+		}
+	};
+
+	/* Set of terminal IDs stored as a bitmap */
+	class terminal_mask {
+	private:
+		std::vector<uint64_t> words;  // Bit i of words[i / 64] is set if terminal ID i is in the set
+
+	public:
+		/* Adds a terminal ID to the set */
+		void set(terminal_id_t id) {
+			size_t word = static_cast<size_t>(id) / 64;
+			if (word >= words.size())
+				words.resize(word + 1, 0);
+			words[word] |= uint64_t(1) << (id % 64);
+		}
+
+		/* Returns true if the terminal ID is in the set */
+		bool test(terminal_id_t id) const {
+			size_t word = static_cast<size_t>(id) / 64;
+			return word < words.size() && ((words[word] >> (id % 64)) & 1) != 0;
+		}
+	};
+
 	/*
 	 * Lexical analyzer class that converts input strings into tokens
 	 *
 	 * This class uses regular expressions to match tokens in the input stream,
 	 * handling whitespace and comments, and reporting lexical errors.
+	 * Every terminal the lexer can produce is assigned a dense terminal ID;
+	 * the end marker always has END_MARKER_TERMINAL_ID.
+	 * Identifiers are scanned without regexes and then checked against the keyword table.
 	 */
 	class lexer {
 	private:
-		std::vector<std::pair<std::regex, parse::symbol_t>> token_patterns;  // Regex patterns for tokens
+		std::vector<std::pair<std::regex, terminal_id_t>> token_patterns;  // Regex patterns for tokens
+		parse::keyword_table keywords;                                       // Keywords recognized among identifiers
+		std::vector<std::pair<std::string, terminal_id_t>> literal_keywords; // Keywords producing literal terminals (e.g. true -> bool_lit)
+		terminal_id_t identifier_terminal = INVALID_TERMINAL_ID;             // Terminal produced by non-keyword identifiers
 		parse::symbol_t end_marker{ "$", parse::symbol_type_t::TERMINAL };   // End of input marker
+		std::vector<parse::symbol_t> terminal_symbols;                       // Terminal symbols indexed by terminal ID
+		std::unordered_map<parse::symbol_t, terminal_id_t, parse::symbol_hasher> terminal_ids;  // Terminal symbol to terminal ID
 		std::vector<std::string> errors;      // Collection of error messages
-		size_t line_number = 1;               // Current line number in input
-		size_t column_number = 1;             // Current column number in input
+		std::string_view source;              // Input (or current window of a streamed input) being pulled from
+		size_t cursor = 0;                    // Position of the next unread byte in source
+		parse::line_index lines;              // Line starts of source, built when a position is first needed
+		parse::source_buffer* streamed_input = nullptr;  // Streamed input, nullptr when lexing a whole buffer
+		uint64_t window_offset = 0;           // Absolute offset of source[0] in a streamed input
+		size_t line_base = 1;                 // Line number of source[0]
+		size_t column_base = 1;               // Column number of source[0]
+		size_t stream_lookahead = 4096;       // Bytes kept available after a token start while streaming
+		parse::string_pool* pool = nullptr;   // Pool interning the lexemes of interned_terminals, nullptr to disable
+		parse::terminal_mask interned_terminals;  // Terminals whose lexemes are interned (identifiers, literals)
+		bool defer_errors = false;            // Collect errors unformatted instead of reporting them (speculative lexing)
+		std::vector<std::pair<size_t, std::string>> deferred_errors;  // Errors collected while defer_errors is set
+
+		/* Tokens lexed from one speculative starting point of a chunk */
+		struct speculative_run_t {
+			size_t start = 0;                  // Position lexing started at
+			size_t end = 0;                    // Position after the last token (input size once the end was reached)
+			std::vector<token_t> tokens;       // Tokens lexed, without the end marker
+			std::vector<std::pair<size_t, std::string>> errors;  // Errors as (position, message)
+		};
 
-		/* Skips whitespace and comments in the input string */
-		void skip_whitespace_and_comments(const std::string& input, size_t& pos) {
-			while (pos < input.size()) {
-				// Skip whitespace characters
-				if (std::isspace(input[pos])) {
-					if (input[pos] == '\n') {
-						line_number++;
-						column_number = 1;
-					}
-					else {
-						column_number++;
-					}
-					pos++;
-					continue;
-				}
+		/*
+		 * Lexes tokens from position from of input until a token ends at or beyond limit
+		 * Runs on a copy of the lexer so several ranges can be lexed concurrently.
+		 */
+		speculative_run_t lex_range(std::string_view input, size_t from, size_t limit) const;
 
-				// Handle single-line comments
-				if (pos + 1 < input.size() && input[pos] == '/' && input[pos + 1] == '/') {
-					pos += 2;
-					column_number += 2;
-					while (pos < input.size() && input[pos] != '\n') {
-						pos++;
-						column_number++;
-					}
-					if (pos < input.size() && input[pos] == '\n') {
-						line_number++;
-						column_number = 1;
-						pos++;
-					}
+		/*
+		 * Lexes the next token, trying only the terminals in acceptable if it is not nullptr
+		 * See next_token(const terminal_mask&) for how the restriction applies.
+		 */
+		token_t lex_token(const terminal_mask* acceptable);
+
+		/*
+		 * Tries the token patterns at cursor and returns the length of the longest match
+		 * Patterns whose terminal is not in acceptable are skipped unless acceptable is nullptr.
+		 * matched is set to the terminal of the match, or INVALID_TERMINAL_ID if nothing matched.
+		 */
+		size_t match_patterns(const terminal_mask* acceptable, terminal_id_t& matched) const;
+
+		/* Returns the terminal ID of a symbol, assigning a new one if it is not known yet */
+		terminal_id_t intern_terminal(const parse::symbol_t& symbol) {
+			auto it = terminal_ids.find(symbol);
+			if (it != terminal_ids.end())
+				return it->second;
+
+			terminal_id_t id = static_cast<terminal_id_t>(terminal_symbols.size());
+			terminal_symbols.push_back(symbol);
+			terminal_ids.emplace(symbol, id);
+			return id;
+		}
+
+		/* Returns true if the character can start an identifier */
+		static bool is_identifier_start(char c) {
+			return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '_';
+		}
+
+		/* Returns true if the character can continue an identifier */
+		static bool is_identifier_char(char c) {
+			return is_identifier_start(c) || (c >= '0' && c <= '9');
+		}
+
+		/* Returns true if the whole string has identifier syntax */
+		static bool is_identifier(std::string_view word) {
+			if (word.empty() || !is_identifier_start(word[0]))
+				return false;
+			for (char c : word) {
+				if (!is_identifier_char(c))
+					return false;
+			}
+			return true;
+		}
+
+		/* Returns true if the symbol is a token class the lexer produces by itself (identifiers, literals) */
+		bool is_token_class(const parse::symbol_t& symbol) const {
+			terminal_id_t id = terminal_id_of(symbol);
+			if (id == INVALID_TERMINAL_ID)
+				return false;
+			if (id == identifier_terminal)
+				return true;
+			for (const auto& pattern : token_patterns) {
+				if (pattern.second == id)
+					return true;
+			}
+			for (const auto& kw : literal_keywords) {
+				if (kw.second == id)
+					return true;
+			}
+			return false;
+		}
+
+		/* Sets the atom of a token just lexed from source if its lexeme is interned */
+		void intern_lexeme(token_t& tok) {
+			if (pool != nullptr && interned_terminals.test(tok.terminal))
+				tok.atom = pool->intern(source.substr(static_cast<size_t>(tok.offset - window_offset), tok.length));
+		}
+
+		/* Returns true if source holds the rest of the input */
+		bool window_is_final() const {
+			return streamed_input == nullptr || streamed_input->at_end();
+		}
+
+		/*
+		 * Slides the window of a streamed input, keeping the bytes from cursor on
+		 * Returns false if there is no more input to buffer.
+		 */
+		bool refill_window() {
+			if (window_is_final())
+				return false;
+
+			// Carry the line/column of the new window start over the bytes about to be discarded
+			std::string_view discarded = source.substr(0, cursor);
+			size_t newlines = simd::count_byte(discarded.data(), 0, discarded.size(), '\n');
+			size_t next_line_base = line_base + newlines;
+			size_t next_column_base = newlines == 0 ? column_base + discarded.size() : discarded.size() - discarded.rfind('\n');
+
+			uint64_t keep_from = window_offset + cursor;
+			if (!streamed_input->refill(keep_from))
+				return false;
+
+			line_base = next_line_base;
+			column_base = next_column_base;
+
+			source = streamed_input->window();
+			window_offset = streamed_input->window_offset();
+			cursor = static_cast<size_t>(keep_from - window_offset);
+			lines.clear();
+			return true;
+		}
+
+		/*
+		 * Skips whitespace and comments in the input string
+		 * Blank runs and comment bodies are scanned a vector block at a time (see simd_scan.h).
+		 * If the input is not final, a comment running into its end is left unconsumed and
+		 * false is returned so the caller can buffer more input and retry.
+		 */
+		bool skip_whitespace_and_comments(std::string_view input, size_t& pos, bool final_input = true) {
+			const char* data = input.data();
+			const size_t size = input.size();
+
+			while (pos < size) {
+				// Skip whitespace characters
+				pos = simd::skip_blanks(data, pos, size);
+				if (pos + 1 >= size || data[pos] != '/')
+					break;
+
+				// Handle single-line comments, the newline is consumed as whitespace
+				if (data[pos + 1] == '/') {
+					size_t newline = simd::find_byte(data, pos + 2, size, '\n');
+					if (newline >= size && !final_input)
+						return false;
+					pos = newline;
 					continue;
 				}
 
 				// Handle multi-line comments
-				if (pos + 1 < input.size() && input[pos] == '/' && input[pos + 1] == '*') {
-					pos += 2;
-					column_number += 2;
-					while (pos + 1 < input.size() && !(input[pos] == '*' && input[pos + 1] == '/')) {
-						if (input[pos] == '\n') {
-							line_number++;
-							column_number = 1;
+				if (data[pos + 1] == '*') {
+					// The terminator needs two bytes, so a '*' in the last byte cannot close the comment
+					size_t star = pos + 2;
+					while (true) {
+						star = simd::find_byte(data, star, size - 1, '*');
+						if (star + 1 >= size) {
+							if (!final_input)
+								return false;
+							pos = std::max(pos + 2, size - 1);
+							add_error("Unterminated multi-line comment", pos);
+							return true;
 						}
-						else {
-							column_number++;
-						}
-						pos++;
-					}
-					if (pos + 1 >= input.size()) {
-						add_error("Unterminated multi-line comment");
-						return;
+						if (data[star + 1] == '/')
+							break;
+						star++;
 					}
-					pos += 2;
-					column_number += 2;
+					pos = star + 2;
 					continue;
 				}
 
 				// Exit when non-whitespace, non-comment content is found
 				break;
 			}
+			return true;
 		}
 
-		/* Adds an error message to the error collection */
-		void add_error(const std::string& message) {
-			std::string error_msg = "Line " + std::to_string(line_number) +
-				", Column " + std::to_string(column_number) +
+		/* Adds an error message for the given position in source to the error collection */
+		void add_error(const std::string& message, size_t pos) {
+			if (defer_errors) {
+				deferred_errors.emplace_back(pos, message);
+				return;
+			}
+
+			source_position_t at = position_of(window_offset + pos);
+			std::string error_msg = "Line " + std::to_string(at.line) +
+				", Column " + std::to_string(at.column) +
 				": " + message;
 			errors.push_back(error_msg);
 			std::cerr << "Lexer Error: " << error_msg << std::endl;
@@ -1170,20 +2282,23 @@ namespace parse {
 	public:
 		/* Constructor that initializes the lexer with default token patterns */
 		lexer() {
+			intern_terminal(end_marker);
+
 			// Add token patterns for common programming language constructs
-			add_token_pattern("\\bint\\b", parse::symbol_t("int", parse::symbol_type_t::TERMINAL));
-			add_token_pattern("\\bfloat\\b", parse::symbol_t("float", parse::symbol_type_t::TERMINAL));
-			add_token_pattern("\\bchar\\b", parse::symbol_t("char", parse::symbol_type_t::TERMINAL));
-			add_token_pattern("\\bbool\\b", parse::symbol_t("bool", parse::symbol_type_t::TERMINAL));
-			add_token_pattern("\\bif\\b", parse::symbol_t("if", parse::symbol_type_t::TERMINAL));
-			add_token_pattern("\\belse\\b", parse::symbol_t("else", parse::symbol_type_t::TERMINAL));
-			add_token_pattern("\\bwhile\\b", parse::symbol_t("while", parse::symbol_type_t::TERMINAL));
-			add_token_pattern("\\breturn\\b", parse::symbol_t("return", parse::symbol_type_t::TERMINAL));
-			add_token_pattern("[a-zA-Z_][a-zA-Z0-9_]*", parse::symbol_t("id", parse::symbol_type_t::TERMINAL));
+			identifier_terminal = intern_terminal(parse::symbol_t("id", parse::symbol_type_t::TERMINAL));
+			add_keyword("int", parse::symbol_t("int", parse::symbol_type_t::TERMINAL));
+			add_keyword("float", parse::symbol_t("float", parse::symbol_type_t::TERMINAL));
+			add_keyword("char", parse::symbol_t("char", parse::symbol_type_t::TERMINAL));
+			add_keyword("bool", parse::symbol_t("bool", parse::symbol_type_t::TERMINAL));
+			add_keyword("if", parse::symbol_t("if", parse::symbol_type_t::TERMINAL));
+			add_keyword("else", parse::symbol_t("else", parse::symbol_type_t::TERMINAL));
+			add_keyword("while", parse::symbol_t("while", parse::symbol_type_t::TERMINAL));
+			add_keyword("return", parse::symbol_t("return", parse::symbol_type_t::TERMINAL));
+			add_literal_keyword("true", parse::symbol_t("bool_lit", parse::symbol_type_t::TERMINAL));
+			add_literal_keyword("false", parse::symbol_t("bool_lit", parse::symbol_type_t::TERMINAL));
 			add_token_pattern("[0-9]+", parse::symbol_t("int_lit", parse::symbol_type_t::TERMINAL));
 			add_token_pattern("[0-9]+\\.[0-9]*", parse::symbol_t("float_lit", parse::symbol_type_t::TERMINAL));
 			add_token_pattern("'.'", parse::symbol_t("char_lit", parse::symbol_type_t::TERMINAL));
-			add_token_pattern("\\btrue\\b|\\bfalse\\b", parse::symbol_t("bool_lit", parse::symbol_type_t::TERMINAL));
 			add_token_pattern("\\+", parse::symbol_t("+", parse::symbol_type_t::TERMINAL));
 			add_token_pattern("\\-", parse::symbol_t("-", parse::symbol_type_t::TERMINAL));
 			add_token_pattern("\\*", parse::symbol_t("*", parse::symbol_type_t::TERMINAL));
@@ -1204,22 +2319,347 @@ namespace parse {
 			add_token_pattern("\\}", parse::symbol_t("}", parse::symbol_type_t::TERMINAL));
 			add_token_pattern("\\;", parse::symbol_t(";", parse::symbol_type_t::TERMINAL));
 			add_token_pattern("\\,", parse::symbol_t(",", parse::symbol_type_t::TERMINAL));
+
+			intern_lexemes_of(parse::symbol_t("id", parse::symbol_type_t::TERMINAL));
+			intern_lexemes_of(parse::symbol_t("int_lit", parse::symbol_type_t::TERMINAL));
+			intern_lexemes_of(parse::symbol_t("float_lit", parse::symbol_type_t::TERMINAL));
+			intern_lexemes_of(parse::symbol_t("char_lit", parse::symbol_type_t::TERMINAL));
+			intern_lexemes_of(parse::symbol_t("bool_lit", parse::symbol_type_t::TERMINAL));
 		}
 
-		/* Adds a token pattern to the lexer */
+		/*
+		 * Adds a token pattern to the lexer
+		 * Patterns are not tried where an identifier starts; register words with add_keyword instead.
+		 */
 		void add_token_pattern(const std::string& pattern, const parse::symbol_t& symbol) {
 			try {
-				token_patterns.emplace_back(std::regex(pattern), symbol);
+				std::regex re(pattern);
+				token_patterns.emplace_back(std::move(re), intern_terminal(symbol));
 			}
 			catch (const std::regex_error& e) {
-				add_error("Invalid regex pattern: " + pattern + " - " + e.what());
+				add_error("Invalid regex pattern: " + pattern + " - " + e.what(), 0);
 			}
 		}
 
+		/* Adds a keyword that is recognized instead of an identifier with the same spelling */
+		void add_keyword(const std::string& word, const parse::symbol_t& symbol) {
+			keywords.add(word, intern_terminal(symbol));
+			keywords.rebuild();
+		}
+
+		/*
+		 * Adds a keyword standing for a literal token class (e.g. true -> bool_lit)
+		 * Unlike plain keywords these survive use_grammar_keywords().
+		 */
+		void add_literal_keyword(const std::string& word, const parse::symbol_t& symbol) {
+			terminal_id_t terminal = intern_terminal(symbol);
+			literal_keywords.emplace_back(word, terminal);
+			keywords.add(word, terminal);
+			keywords.rebuild();
+		}
+
+		/*
+		 * Replaces the keyword set with the keywords used by a grammar
+		 * Every identifier-shaped terminal of the grammar that is not a token class produced by
+		 * the lexer itself (id, int_lit, ...) becomes a keyword; other words lex as identifiers.
+		 */
+		void use_grammar_keywords(const parse::lalr_grammar& grammar) {
+			keywords.clear();
+			for (const auto& kw : literal_keywords)
+				keywords.add(kw.first, kw.second);
+
+			for (const auto& t : grammar.terminals) {
+				if (!is_identifier(t.name) || is_token_class(t))
+					continue;
+				keywords.add(t.name, intern_terminal(t));
+			}
+
+			keywords.rebuild();
+		}
+
+		/*
+		 * Attaches a string pool that interns the lexemes of identifiers and literals
+		 * Tokens of those terminals then carry the atom of their lexeme, which stays valid
+		 * after the input is gone. Several lexers may share a pool, but not concurrently.
+		 * Pass nullptr to stop interning.
+		 */
+		void set_string_pool(parse::string_pool* string_pool) {
+			pool = string_pool;
+		}
+
+		/* Interns the lexemes of a terminal when a string pool is attached (id and the literal classes by default) */
+		void intern_lexemes_of(const parse::symbol_t& symbol) {
+			interned_terminals.set(intern_terminal(symbol));
+		}
+
+		/* Returns the terminal symbol corresponding to a terminal ID */
+		const parse::symbol_t& symbol_of(terminal_id_t id) const {
+			return terminal_symbols[id];
+		}
+
+		/* Returns the terminal ID of a symbol, or INVALID_TERMINAL_ID if the lexer never produces it */
+		terminal_id_t terminal_id_of(const parse::symbol_t& symbol) const {
+			auto it = terminal_ids.find(symbol);
+			return it != terminal_ids.end() ? it->second : INVALID_TERMINAL_ID;
+		}
+
+		/* Returns the number of terminal IDs assigned so far */
+		size_t terminal_count() const {
+			return terminal_symbols.size();
+		}
+
+		/*
+		 * Converts a byte offset of the current input to a line/column pair
+		 * The line index is built on the first call after begin(), so lexing itself never tracks lines.
+		 * For a streamed input only offsets inside the current window can be resolved; earlier
+		 * offsets report the position of the window start.
+		 */
+		source_position_t position_of(uint64_t offset) {
+			if (offset < window_offset)
+				return { line_base, column_base };
+
+			if (lines.empty() && !source.empty())
+				lines.build(source);
+
+			source_position_t at = lines.position_of(static_cast<size_t>(offset - window_offset));
+			if (at.line == 1)
+				at.column += column_base - 1;
+			at.line += line_base - 1;
+			return at;
+		}
+
+		/*
+		 * Returns the lexeme of a token taken from the current input
+		 * For a streamed input the view is only valid until the next call to next_token().
+		 */
+		std::string_view lexeme_of(const token_t& tok) const {
+			return source.substr(static_cast<size_t>(tok.offset - window_offset), tok.length);
+		}
+
+		/*
+		 * Sets how many bytes must be buffered after a token start while streaming
+		 * Token patterns must be decidable within this many bytes.
+		 */
+		void set_stream_lookahead(size_t bytes) {
+			stream_lookahead = std::max<size_t>(bytes, 2);
+		}
+
+		/* Returns the error messages reported by the last tokenization */
+		const std::vector<std::string>& get_errors() const {
+			return errors;
+		}
+
+		/*
+		 * Starts pulling tokens from an input buffer
+		 * The buffer must outlive every token returned by next_token().
+		 */
+		void begin(std::string_view input);
+
+		/*
+		 * Starts pulling tokens from a streamed input
+		 * Token offsets are absolute offsets in the input; the source must outlive the lexing.
+		 */
+		void begin(parse::source_buffer& src);
+
+		/*
+		 * Lexes and returns the next token of the current input
+		 * Once the input is exhausted the end marker token is returned on every call.
+		 */
+		token_t next_token() {
+			return lex_token(nullptr);
+		}
+
+		/*
+		 * Lexes the next token trying only the terminals the parser can accept next
+		 *
+		 * Only token patterns of acceptable terminals are tried. A keyword that is not acceptable
+		 * where an identifier is lexes as an identifier, so grammar keywords stay usable as names
+		 * in other positions. If no acceptable pattern matches, all patterns are tried so the
+		 * parser still sees (and reports) the offending token.
+		 */
+		token_t next_token(const terminal_mask& acceptable) {
+			return lex_token(&acceptable);
+		}
+
+		/*
+		 * Tokenizes an input buffer into compact tokens referencing spans of it
+		 * The last token is always the end marker (empty span at the end of input).
+		 */
+		std::vector<token_t> tokenize_spans(std::string_view input);
+
+		/*
+		 * Tokenizes a large input buffer on several threads
+		 *
+		 * The buffer is split into chunks that are lexed concurrently, each speculatively as if it
+		 * started between tokens. Only a chunk where the previous chunk's run does not end on one
+		 * of its token boundaries is lexed again, concurrently, from the other plausible contexts:
+		 * inside a block comment and inside a line comment. Chunks are stitched in order by
+		 * finding the speculative run that has a token boundary where the previous chunk stopped;
+		 * a chunk without such a run is re-lexed from that point. The result, including reported errors, is identical to
+		 * tokenize_spans(). Inputs too small for two chunks of min_chunk_size are lexed serially.
+		 */
+		std::vector<token_t> tokenize_parallel(std::string_view input, size_t thread_count = 0, size_t min_chunk_size = 1 << 16);
+
 		/* Tokenizes an input string into a sequence of tokens */
 		std::vector<std::pair<parse::symbol_t, std::string>> tokenize(const std::string& input);
 	};
 
+	/* Totals of the parses counted by a parser_counters, see parser_counters::collect() */
+	struct parser_counts_t {
+		uint64_t parses = 0;           // Parses run
+		uint64_t accepted = 0;         // Parses that accepted their input
+		uint64_t tokens = 0;           // Tokens shifted
+		uint64_t max_tokens = 0;       // Tokens shifted by the longest parse
+		uint64_t shifts = 0;           // Shift actions (one per token)
+		uint64_t reductions = 0;       // Reduce actions
+		uint64_t gotos = 0;            // GOTO transitions taken after a reduction
+		uint64_t max_stack_depth = 0;  // Deepest state stack reached
+		std::vector<uint64_t> tokens_per_parse;          // Parses by token count: bucket 0 counts empty parses, bucket b > 0 those of [2^(b-1), 2^b) tokens
+		std::vector<uint64_t> reductions_by_production;  // Reductions by production ID
+		std::vector<uint64_t> state_visits;              // ACTION lookups by state
+
+		/* Returns the n production IDs reduced most often with their counts, most frequent first */
+		std::vector<std::pair<production_id_t, uint64_t>> top_productions(size_t n) const;
+
+		/* Returns the n states visited most often with their counts, most frequent first */
+		std::vector<std::pair<item_set_id_t, uint64_t>> top_states(size_t n) const;
+
+		/* Converts the counts to a report naming the productions of the grammar they were counted with */
+		std::string to_string(const lalr_grammar& grammar, size_t top = 10) const;
+	};
+
+	/*
+	 * Runtime counters of lr_parser, for monitoring which parts of a grammar the traffic uses
+	 *
+	 * Every parser attached with lr_parser::set_counters() writes to a slot of its own, so the
+	 * counters cost no locked instructions and no cache line is shared between parsers on
+	 * different threads: a slot and its histograms are 64-byte aligned and padded to whole
+	 * cache lines. A step adds to a few counters with plain loads and stores. collect()
+	 * sums the slots on demand and may run while the parsers are running; it sees each counter
+	 * at some recent value. A slot is kept when its parser goes away and handed to the next
+	 * parser attached, so short-lived parsers do not make the counters grow.
+	 * Only counted if __LALR1_PARSER_COUNTERS__ is defined.
+	 */
+	class parser_counters {
+	public:
+		/* Counter with a single writer: relaxed atomic accesses, so reading it from another thread is no data race */
+		class counter_t {
+		private:
+			std::atomic<uint64_t> value{ 0 };
+
+		public:
+			void add(uint64_t n = 1) {
+				value.store(value.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+			}
+
+			void raise_to(uint64_t n) {
+				if (n > value.load(std::memory_order_relaxed))
+					value.store(n, std::memory_order_relaxed);
+			}
+
+			uint64_t load() const {
+				return value.load(std::memory_order_relaxed);
+			}
+
+			void reset() {
+				value.store(0, std::memory_order_relaxed);
+			}
+		};
+
+		static constexpr size_t TOKEN_BUCKETS = 48;  // Buckets of parser_counts_t::tokens_per_parse
+
+		static constexpr size_t COUNTERS_PER_LINE = 64 / sizeof(counter_t);  // Counters on a cache line
+
+		/* One cache line of counters; histograms are allocated in whole lines so they share none */
+		struct alignas(64) counter_line_t {
+			counter_t counters[COUNTERS_PER_LINE];
+		};
+
+		/* Counters of one parser, on cache lines of their own */
+		struct alignas(64) slot_t {
+			counter_t parses, accepted, shifts, reductions, gotos, max_stack_depth, max_tokens;
+			counter_t tokens_per_parse[TOKEN_BUCKETS];
+			std::unique_ptr<counter_line_t[]> histograms;  // Reductions by production ID, then visits by state from state_line on
+			size_t state_line = 0;                         // First line of the visits by state in histograms
+
+			counter_t& production_reductions(production_id_t production) {
+				const size_t i = static_cast<size_t>(production);
+				return histograms[i / COUNTERS_PER_LINE].counters[i % COUNTERS_PER_LINE];
+			}
+
+			counter_t& state_visits(item_set_id_t state) {
+				const size_t i = static_cast<size_t>(state);
+				return histograms[state_line + i / COUNTERS_PER_LINE].counters[i % COUNTERS_PER_LINE];
+			}
+
+			void visit(item_set_id_t state) {
+				state_visits(state).add();
+			}
+
+			void shift(size_t depth) {
+				shifts.add();
+				max_stack_depth.raise_to(depth);
+			}
+
+			void reduce(production_id_t production) {
+				reductions.add();
+				production_reductions(production).add();
+			}
+
+			void go_to(size_t depth) {
+				gotos.add();
+				max_stack_depth.raise_to(depth);
+			}
+
+			/* Counts the end of a parse that shifted the given number of tokens */
+			void end_parse(uint64_t tokens, bool was_accepted) {
+				parses.add();
+				if (was_accepted)
+					accepted.add();
+				max_tokens.raise_to(tokens);
+
+				size_t bucket = 0;
+				while (tokens > 0 && bucket + 1 < TOKEN_BUCKETS) {
+					tokens >>= 1;
+					bucket++;
+				}
+				tokens_per_parse[bucket].add();
+			}
+		};
+
+	private:
+		const lalr_grammar* grammar;                  // Grammar the tables of the counted parsers come from
+		size_t production_count;                      // Counters of slot_t::production_reductions()
+		size_t state_count;                           // Counters of slot_t::state_visits()
+		mutable std::mutex mutex;                     // Guards slots and free_slots
+		std::vector<std::unique_ptr<slot_t>> slots;   // Slots handed out so far
+		std::vector<slot_t*> free_slots;              // Slots whose parsers went away
+
+	public:
+		/* Counters for parsers of a grammar whose tables are built; the grammar must outlive them */
+		explicit parser_counters(const lalr_grammar& grammar);
+
+		parser_counters(const parser_counters&) = delete;
+		parser_counters& operator=(const parser_counters&) = delete;
+
+		/* Returns true if the counters were made for the given grammar */
+		bool counts(const lalr_grammar& g) const {
+			return grammar == &g;
+		}
+
+		/* Hands out a slot for one parser */
+		slot_t& acquire();
+
+		/* Takes back a slot whose parser no longer writes to it; its counts are kept */
+		void release(slot_t& slot);
+
+		/* Sums the counts of all slots */
+		parser_counts_t collect() const;
+
+		/* Sets all counts to zero; counts written by running parsers at the same time may be lost */
+		void reset();
+	};
+
 	/*
 	 * LALR(1) parser class that uses the grammar and ACTION/GOTO tables to parse input
 	 *
@@ -1234,16 +2674,43 @@ namespace parse {
 		std::vector<std::string> parse_history;       // History of parsing actions
 		std::vector<std::string> error_msg;           // Collection of error messages
 
+		bool context_aware_lexing = false;            // Let the current state restrict the terminals the lexer tries
+		std::vector<parse::terminal_mask> state_masks;  // Acceptable lexer terminal IDs per state
+		const parse::lexer* state_masks_lexer = nullptr;  // Lexer whose terminal IDs state_masks uses
+		size_t state_masks_terminals = 0;             // Terminal count of that lexer when state_masks was built
+
+		std::shared_ptr<parse::parser_counters> counters;     // Counters the parses are counted in, if any
+		parse::parser_counters::slot_t* counter_slot = nullptr;  // Slot of this parser in counters
+
 	public:
-		std::unique_ptr<parse::lalr_grammar> grammar;  // The grammar used for parsing
+		std::shared_ptr<const parse::lalr_grammar> grammar;  // The grammar used for parsing, never changed once built
 
 		/* Constructor that takes a grammar and builds the parsing tables */
 		lr_parser(std::unique_ptr<parse::lalr_grammar> g) {
+			g->build();
 			grammar = std::move(g);
-			grammar->build();
 			state_stack.push(0);  // Start with initial state
 		}
 
+		/*
+		 * Constructor that shares a grammar whose tables are already built, e.g. one handed out
+		 * by a grammar_registry; any number of parsers on any threads may share it.
+		 * Throws std::invalid_argument if the tables have not been built.
+		 */
+		explicit lr_parser(std::shared_ptr<const parse::lalr_grammar> built) : grammar(std::move(built)) {
+			if (!grammar || grammar->lalr1_states.empty())
+				throw std::invalid_argument("lr_parser needs a grammar whose tables are built");
+			state_stack.push(0);  // Start with initial state
+		}
+
+		/* Parsers own a counter slot, see set_counters() */
+		lr_parser(const lr_parser&) = delete;
+		lr_parser& operator=(const lr_parser&) = delete;
+
+		~lr_parser() {
+			set_counters(nullptr);
+		}
+
 		/* Structure to hold the result of a parsing operation */
 		struct parse_result {
 			bool success = false;                 // Whether parsing was successful
@@ -1254,6 +2721,42 @@ namespace parse {
 		/* Parses a sequence of tokens and returns the result */
 		parse_result parse(const std::vector<std::pair<parse::symbol_t, std::string>>& input_tokens);
 
+		/* Parses a sequence of compact tokens whose terminal IDs were assigned by the given lexer */
+		parse_result parse(const std::vector<parse::token_t>& input_tokens, const parse::lexer& lex);
+
+		/*
+		 * Parses an input buffer, pulling tokens from the lexer on demand
+		 * Lexing and parsing run in one pass; only the current lookahead token is held in memory.
+		 */
+		parse_result parse(parse::lexer& lex, std::string_view input);
+
+		/* Parses a streamed input, pulling tokens from the lexer on demand */
+		parse_result parse(parse::lexer& lex, parse::source_buffer& src);
+
+		/*
+		 * Enables or disables context-aware lexing for the parse overloads that pull tokens
+		 * from a lexer
+		 * Each token is then lexed trying only the terminals that have an entry in the ACTION
+		 * row of the current state (see lexer::next_token(const terminal_mask&)).
+		 */
+		void set_context_aware_lexing(bool enabled) {
+			context_aware_lexing = enabled;
+		}
+
+		/*
+		 * Counts the parses of this parser in the given counters, or stops counting if nullptr
+		 * Any number of parsers of the same grammar, on any threads, may share the counters.
+		 * Throws std::invalid_argument if the counters were made for another grammar.
+		 */
+		void set_counters(std::shared_ptr<parse::parser_counters> c) {
+			if (c && !c->counts(*grammar))
+				throw std::invalid_argument("parser_counters were made for another grammar");
+			if (counter_slot != nullptr)
+				counters->release(*counter_slot);
+			counters = std::move(c);
+			counter_slot = counters ? &counters->acquire() : nullptr;
+		}
+
 		/* Returns the collection of error messages */
 		const std::vector<std::string>& get_error() const { return error_msg; }
 
@@ -1272,6 +2775,20 @@ namespace parse {
 		}
 
 	private:
+		/*
+		 * Runs the LR automaton over a token stream
+		 * The stream provides peek() returning the current terminal symbol (the end marker
+		 * once the input is exhausted) and advance() consuming it.
+		 */
+		template <typename token_stream_t>
+		parse_result run(token_stream_t& stream);
+
+		/* Runs the automaton over tokens pulled from a lexer on which begin() has been called */
+		parse_result run_lexer(parse::lexer& lex);
+
+		/* Builds the acceptable terminal set of every state from the keys of its ACTION row, in the lexer's terminal IDs */
+		void build_state_masks(const parse::lexer& lex);
+
 		/* Attempts to recover from a parsing error */
 		bool error_recovery(
 			std::stack<int>& state_stack,
@@ -1304,6 +2821,7 @@ namespace parse {
 //	};
 //}
 
+/* Loads a grammar file (see parse::load_grammar_file); throws parse::grammar_error if it is malformed */
 std::unique_ptr<parse::lalr_grammar> grammar_parser(const std::string& filename);
 
 #endif  // __LR_PARSER_H__
@@ -0,0 +1,563 @@
+#include "sentence_generator.h"
+
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+#include <unordered_map>
+
+
+namespace {
+
+	/* Random expansions averaged to estimate the size of each non-terminal */
+	constexpr size_t LENGTH_SAMPLES = 32;
+
+	/* Lines are broken after this many bytes */
+	constexpr size_t LINE_LENGTH = 80;
+
+	/* Streamed text is flushed once this many bytes are buffered */
+	constexpr size_t FLUSH_SIZE = 1 << 16;
+
+	/* Mutations tried before a near miss is given up on the tables rejecting it */
+	constexpr size_t MUTATION_ATTEMPTS = 32;
+
+	/* Sentences tried before one the tables reject is returned anyway */
+	constexpr size_t VALIDATION_ATTEMPTS = 64;
+
+	/* A pending symbol of an expansion */
+	struct frame_t {
+		int32_t symbol;      // Non-terminal index, or -1 - terminal index
+		bool grow;           // On the growing spine of the sentence
+		size_t height_left;  // Height its derivation tree may still have
+		size_t depth;        // Levels below the root of its randomly expanded subtree
+		bool loop;           // Repeats a directly left-recursive alternative of symbol while the sentence is short
+	};
+
+}
+
+
+parse::sentence_generator::sentence_generator(const lalr_grammar& g, const lexer& lex, uint64_t seed)
+	: grammar(g), rng(seed)
+{
+	std::unordered_map<symbol_t, symbol_ref_t, symbol_hasher> index;
+	auto index_of = [&](const symbol_t& s) -> symbol_ref_t {
+		auto it = index.find(s);
+		if (it != index.end())
+			return it->second;
+		symbol_ref_t ref;
+		if (s.type == symbol_type_t::NON_TERMINAL) {
+			ref = static_cast<symbol_ref_t>(non_terminals.size());
+			non_terminals.push_back(s);
+		}
+		else {
+			ref = -1 - static_cast<symbol_ref_t>(terminals.size());
+			terminals.push_back(s);
+		}
+		index.emplace(s, ref);
+		return ref;
+	};
+
+	start = static_cast<size_t>(index_of(grammar.start_symbol));
+
+	// Rules in production ID order, so that the numbering does not depend on hashing
+	std::vector<std::shared_ptr<production_t>> productions;
+	for (const auto& entry : grammar.productions) {
+		for (const auto& prod : entry.second) {
+			if (prod->id != AUGMENTED_GRAMMAR_PROD_ID)
+				productions.push_back(prod);
+		}
+	}
+	std::sort(productions.begin(), productions.end(),
+		[](const auto& a, const auto& b) { return a->id < b->id; });
+
+	for (const auto& prod : productions) {
+		rule_t rule;
+		rule.left = static_cast<size_t>(index_of(prod->left));
+		bool lexable = true;
+		for (const auto& s : prod->right) {
+			if (s == grammar.epsilon)
+				continue;
+			if (s.type == symbol_type_t::TERMINAL && lex.terminal_id_of(s) == INVALID_TERMINAL_ID)
+				lexable = false;
+			rule.right.push_back(index_of(s));
+		}
+		if (lexable)
+			rules.push_back(std::move(rule));
+	}
+
+	for (size_t i = 0; i < lex.terminal_count(); i++)
+		reserved.insert(lex.symbol_of(static_cast<terminal_id_t>(i)).name);
+	reserved.insert("true");
+	reserved.insert("false");
+
+	// Shortest derivations, to a fixpoint
+	size_t n = non_terminals.size();
+	const size_t UNKNOWN = SIZE_MAX;
+	min_length.assign(n, UNKNOWN);
+	min_height.assign(n, UNKNOWN);
+	for (bool changed = true; changed; ) {
+		changed = false;
+		for (rule_t& rule : rules) {
+			size_t length = 0, height = 0;
+			bool known = true;
+			for (symbol_ref_t s : rule.right) {
+				if (s < 0) {
+					length++;
+					continue;
+				}
+				if (min_length[s] == UNKNOWN) {
+					known = false;
+					break;
+				}
+				length += min_length[s];
+				height = std::max(height, min_height[s]);
+			}
+			if (!known)
+				continue;
+			rule.min_length = length;
+			rule.height = height + 1;
+			if (length < min_length[rule.left] || rule.height < min_height[rule.left]) {
+				min_length[rule.left] = std::min(min_length[rule.left], length);
+				min_height[rule.left] = std::min(min_height[rule.left], rule.height);
+				changed = true;
+			}
+		}
+	}
+	if (min_length[start] == UNKNOWN)
+		throw std::runtime_error("Start symbol " + grammar.start_symbol.name + " derives no sentence the lexer can produce");
+
+	// Rules using a non-terminal without any sentence can never be finished
+	rules.erase(std::remove_if(rules.begin(), rules.end(), [&](const rule_t& rule) {
+		for (symbol_ref_t s : rule.right) {
+			if (s >= 0 && min_length[s] == UNKNOWN)
+				return true;
+		}
+		return false;
+	}), rules.end());
+
+	rules_of.assign(n, {});
+	std::vector<bool> terminal_used(terminals.size(), false);
+	for (size_t r = 0; r < rules.size(); r++) {
+		rules_of[rules[r].left].push_back(r);
+		for (symbol_ref_t s : rules[r].right) {
+			if (s < 0)
+				terminal_used[-1 - s] = true;
+		}
+	}
+	for (size_t t = 0; t < terminals.size(); t++) {
+		if (terminal_used[t])
+			usable_terminals.push_back(t);
+	}
+
+	// Which non-terminals appear in derivations of which, to a fixpoint
+	reaches.assign(n, std::vector<bool>(n, false));
+	for (const rule_t& rule : rules) {
+		for (symbol_ref_t s : rule.right) {
+			if (s >= 0)
+				reaches[rule.left][s] = true;
+		}
+	}
+	for (size_t k = 0; k < n; k++) {
+		for (size_t a = 0; a < n; a++) {
+			if (!reaches[a][k])
+				continue;
+			for (size_t b = 0; b < n; b++) {
+				if (reaches[k][b])
+					reaches[a][b] = true;
+			}
+		}
+	}
+	can_grow.assign(n, false);
+	for (size_t a = 0; a < n; a++) {
+		for (size_t b = 0; b < n; b++) {
+			if (reaches[a][b] && reaches[b][b])
+				can_grow[a] = true;
+		}
+	}
+	for (rule_t& rule : rules) {
+		for (symbol_ref_t s : rule.right) {
+			if (s >= 0 && (static_cast<size_t>(s) == rule.left || reaches[s][rule.left]))
+				rule.recursive = true;
+		}
+	}
+
+	// Average size of random expansions, used to tell when a growing sentence is long enough
+	expected_length.assign(n, 0);
+	sentence_options_t defaults;
+	sink_t discard;
+	for (size_t a = 0; a < n; a++) {
+		if (min_length[a] == UNKNOWN)
+			continue;
+		size_t total = 0;
+		for (size_t i = 0; i < LENGTH_SAMPLES; i++)
+			total += expand(a, false, defaults, discard);
+		expected_length[a] = static_cast<double>(total) / LENGTH_SAMPLES;
+	}
+
+	// Growing along a rule A -> A or A -> A B with B nearly always empty would never end
+	for (rule_t& rule : rules) {
+		double step = 0;
+		bool direct = false;
+		for (symbol_ref_t s : rule.right) {
+			if (s < 0)
+				step += 1;
+			else if (static_cast<size_t>(s) == rule.left && !direct)
+				direct = true;
+			else
+				step += expected_length[s];
+		}
+		rule.stalls = direct && step == 0;
+	}
+}
+
+void parse::sentence_generator::spell(size_t terminal, std::string& text)
+{
+	const std::string& name = terminals[terminal].name;
+
+	if (name == "id") {
+		std::string word;
+		do {
+			word.clear();
+			size_t length = 1 + pick(8);
+			for (size_t i = 0; i < length; i++)
+				word += static_cast<char>('a' + pick(26));
+			if (pick(4) == 0)
+				word += static_cast<char>('0' + pick(10));
+		} while (reserved.count(word));
+		text += word;
+	}
+	else if (name == "int_lit") {
+		text += std::to_string(pick(100000));
+	}
+	else if (name == "float_lit") {
+		text += std::to_string(pick(1000)) + "." + std::to_string(pick(1000));
+	}
+	else if (name == "char_lit") {
+		text += '\'';
+		text += static_cast<char>('a' + pick(26));
+		text += '\'';
+	}
+	else if (name == "bool_lit") {
+		text += pick(2) ? "true" : "false";
+	}
+	else {
+		text += name;
+	}
+}
+
+void parse::sentence_generator::emit(size_t terminal, sink_t& sink)
+{
+	if (sink.tokens != nullptr)
+		sink.tokens->push_back(terminals[terminal]);
+	if (sink.text == nullptr)
+		return;
+
+	std::string& text = *sink.text;
+	size_t before = text.size();
+	spell(terminal, text);
+	sink.column += text.size() - before;
+
+	const std::string& name = terminals[terminal].name;
+	if (name == ";" || name == "{" || name == "}" || sink.column >= LINE_LENGTH) {
+		text += '\n';
+		sink.column = 0;
+	}
+	else {
+		text += ' ';
+		sink.column++;
+	}
+
+	if (sink.out != nullptr && text.size() >= FLUSH_SIZE) {
+		sink.out->write(text.data(), static_cast<std::streamsize>(text.size()));
+		text.clear();
+	}
+}
+
+size_t parse::sentence_generator::expand(size_t symbol, bool grow, const sentence_options_t& options, sink_t& sink)
+{
+	size_t produced = 0;
+	double pending = 0;  // Expected tokens of the frames still on the stack
+
+	auto subtree = [&](symbol_ref_t s, bool grow_on) {
+		size_t height = s >= 0 ? std::max(min_height[s], options.max_depth) : 0;
+		return frame_t{ s, grow_on, height, 0, false };
+	};
+
+	std::vector<frame_t> stack{ subtree(static_cast<symbol_ref_t>(symbol), grow) };
+	std::vector<size_t> candidates;
+	std::vector<double> weights;
+	std::vector<frame_t> children;
+
+	while (!stack.empty()) {
+		frame_t frame = stack.back();
+		stack.pop_back();
+
+		if (frame.symbol < 0) {
+			pending -= 1;
+			emit(static_cast<size_t>(-1 - frame.symbol), sink);
+			produced++;
+			continue;
+		}
+
+		size_t a = static_cast<size_t>(frame.symbol);
+
+		if (frame.loop) {
+			// A -> A x: the A expanded so far is followed by one more x, as long as the sentence is short
+			if (static_cast<double>(produced) + pending >= static_cast<double>(options.target_tokens))
+				continue;
+			candidates.clear();
+			for (size_t r : rules_of[a]) {
+				if (!rules[r].right.empty() && rules[r].right[0] == frame.symbol && !rules[r].stalls)
+					candidates.push_back(r);
+			}
+			if (candidates.empty())
+				continue;
+			const rule_t& rule = rules[candidates[pick(candidates.size())]];
+			stack.push_back(frame);
+			for (size_t i = rule.right.size() - 1; i > 0; i--) {
+				stack.push_back(subtree(rule.right[i], false));
+				pending += rule.right[i] >= 0 ? expected_length[rule.right[i]] : 1;
+			}
+			continue;
+		}
+
+		pending -= expected_length[a];
+		bool growing = frame.grow && static_cast<double>(produced) + pending < static_cast<double>(options.target_tokens);
+
+		candidates.clear();
+		weights.clear();
+		if (growing) {
+			// Keep the recursion going, or head for the recursive non-terminal below
+			for (size_t r : rules_of[a]) {
+				bool keeps = rules[r].recursive && !rules[r].stalls;
+				if (!reaches[a][a]) {
+					for (symbol_ref_t s : rules[r].right)
+						keeps = keeps || (s >= 0 && can_grow[s]);
+				}
+				if (keeps) {
+					candidates.push_back(r);
+					weights.push_back(1);
+				}
+			}
+			growing = !candidates.empty();
+		}
+		if (!growing) {
+			double recursive_weight = std::pow(options.recursion_weight, static_cast<double>(frame.depth + 1));
+			for (size_t r : rules_of[a]) {
+				if (rules[r].height <= frame.height_left) {
+					candidates.push_back(r);
+					weights.push_back(rules[r].recursive ? recursive_weight : 1);
+				}
+			}
+		}
+
+		double total = 0;
+		for (double w : weights)
+			total += w;
+		double x = pick_unit() * total;
+		size_t chosen = 0;
+		while (chosen + 1 < candidates.size() && x >= weights[chosen])
+			x -= weights[chosen++];
+		const rule_t& rule = rules[candidates[chosen]];
+
+		// A growing list A -> A x is produced front to back, so that the stack does not hold every x
+		if (growing && !rule.right.empty() && rule.right[0] == frame.symbol) {
+			stack.push_back(frame_t{ frame.symbol, false, 0, 0, true });
+			stack.push_back(subtree(frame.symbol, false));
+			pending += expected_length[a];
+			continue;
+		}
+
+		// The first symbol carrying the growth on stays on the spine; the others start random subtrees
+		bool grow_passed = false;
+		children.clear();
+		for (symbol_ref_t s : rule.right) {
+			frame_t child{ s, false, frame.height_left - 1, frame.depth + 1, false };
+			if (s >= 0) {
+				if (growing) {
+					bool carries = reaches[a][a] ? (static_cast<size_t>(s) == a || reaches[s][a]) : can_grow[s];
+					child.grow = !grow_passed && carries;
+					grow_passed = grow_passed || carries;
+					child.height_left = std::max(min_height[s], options.max_depth);
+					child.depth = 0;
+				}
+				pending += expected_length[s];
+			}
+			else {
+				pending += 1;
+			}
+			children.push_back(child);
+		}
+		stack.insert(stack.end(), children.rbegin(), children.rend());
+	}
+
+	return produced;
+}
+
+bool parse::sentence_generator::accepts(const std::vector<symbol_t>& tokens) const
+{
+	std::vector<item_set_id_t> states{ 0 };
+	size_t next = 0;
+
+	while (true) {
+		const symbol_t& lookahead = next < tokens.size() ? tokens[next] : grammar.end_marker;
+
+		auto row = grammar.action_table.find(states.back());
+		if (row == grammar.action_table.end())
+			return false;
+		auto entry = row->second.find(lookahead);
+		if (entry == row->second.end())
+			return false;
+
+		const parser_action_t& action = entry->second;
+		switch (action.type) {
+		case parser_action_type_t::SHIFT:
+			states.push_back(action.value);
+			next++;
+			break;
+
+		case parser_action_type_t::REDUCE: {
+			auto prod = grammar.get_production_by_id(action.value);
+			bool is_epsilon = prod->right.size() == 1 && prod->right[0] == grammar.epsilon;
+			size_t pop = is_epsilon ? 0 : prod->right.size();
+			if (pop >= states.size())
+				return false;
+			states.resize(states.size() - pop);
+			auto target = grammar.goto_table.find({ states.back(), prod->left });
+			if (target == grammar.goto_table.end())
+				return false;
+			states.push_back(target->second);
+			break;
+		}
+
+		case parser_action_type_t::ACCEPT:
+			return next == tokens.size();
+
+		default:
+			return false;
+		}
+	}
+}
+
+void parse::sentence_generator::mutate(near_miss_t& sentence)
+{
+	std::vector<symbol_t>& tokens = sentence.tokens;
+	auto random_terminal = [&]() { return terminals[usable_terminals[pick(usable_terminals.size())]]; };
+
+	// Every mutation but insertion needs a token to edit, swapping two different ones
+	bool can_swap = false;
+	for (size_t i = 0; i + 1 < tokens.size(); i++)
+		can_swap = can_swap || tokens[i] != tokens[i + 1];
+
+	while (true) {
+		sentence.mutation = static_cast<mutation_t>(pick(4));
+		if (tokens.empty() && sentence.mutation != mutation_t::INSERT_TOKEN)
+			continue;
+		if (sentence.mutation == mutation_t::REPLACE_TOKEN && usable_terminals.size() < 2)
+			continue;
+		if (sentence.mutation == mutation_t::SWAP_TOKENS && !can_swap)
+			continue;
+		break;
+	}
+
+	switch (sentence.mutation) {
+	case mutation_t::DELETE_TOKEN:
+		sentence.position = pick(tokens.size());
+		tokens.erase(tokens.begin() + sentence.position);
+		break;
+
+	case mutation_t::INSERT_TOKEN:
+		sentence.position = pick(tokens.size() + 1);
+		tokens.insert(tokens.begin() + sentence.position, random_terminal());
+		break;
+
+	case mutation_t::REPLACE_TOKEN: {
+		sentence.position = pick(tokens.size());
+		symbol_t replacement = random_terminal();
+		while (replacement == tokens[sentence.position])
+			replacement = random_terminal();
+		tokens[sentence.position] = replacement;
+		break;
+	}
+
+	case mutation_t::SWAP_TOKENS:
+		do {
+			sentence.position = pick(tokens.size() - 1);
+		} while (tokens[sentence.position] == tokens[sentence.position + 1]);
+		std::swap(tokens[sentence.position], tokens[sentence.position + 1]);
+		break;
+	}
+}
+
+void parse::sentence_generator::respell(generated_sentence_t& sentence)
+{
+	std::unordered_map<symbol_t, size_t, symbol_hasher> terminal_index;
+	for (size_t t = 0; t < terminals.size(); t++)
+		terminal_index.emplace(terminals[t], t);
+
+	sink_t sink;
+	sink.text = &sentence.text;
+	sentence.text.clear();
+	for (const symbol_t& s : sentence.tokens)
+		emit(terminal_index.at(s), sink);
+}
+
+parse::generated_sentence_t parse::sentence_generator::generate(const sentence_options_t& options)
+{
+	bool checkable = !grammar.lalr1_states.empty();
+	generated_sentence_t sentence;
+
+	for (size_t attempt = 0; attempt < VALIDATION_ATTEMPTS; attempt++) {
+		sentence.tokens.clear();
+		sentence.text.clear();
+		sink_t sink;
+		sink.tokens = &sentence.tokens;
+		sink.text = &sentence.text;
+		expand(start, true, options, sink);
+		if (!checkable || accepts(sentence.tokens))
+			break;
+	}
+	return sentence;
+}
+
+size_t parse::sentence_generator::generate(std::ostream& out, const sentence_options_t& options)
+{
+	std::string buffer;
+	sink_t sink;
+	sink.text = &buffer;
+	sink.out = &out;
+	size_t tokens = expand(start, true, options, sink);
+	out.write(buffer.data(), static_cast<std::streamsize>(buffer.size()));
+	return tokens;
+}
+
+parse::near_miss_t parse::sentence_generator::generate_near_miss(const sentence_options_t& options)
+{
+	bool checkable = !grammar.lalr1_states.empty();
+	near_miss_t sentence;
+	std::vector<symbol_t> valid = generate(options).tokens;
+	for (size_t attempt = 0; attempt < MUTATION_ATTEMPTS; attempt++) {
+		sentence.tokens = valid;
+		mutate(sentence);
+		if (!checkable || !accepts(sentence.tokens))
+			break;
+	}
+
+	respell(sentence);
+	return sentence;
+}
+
+const char* parse::mutation_name(mutation_t mutation)
+{
+	switch (mutation) {
+	case mutation_t::DELETE_TOKEN:
+		return "delete_token";
+	case mutation_t::INSERT_TOKEN:
+		return "insert_token";
+	case mutation_t::REPLACE_TOKEN:
+		return "replace_token";
+	case mutation_t::SWAP_TOKENS:
+		return "swap_tokens";
+	default:
+		return "unknown";
+	}
+}
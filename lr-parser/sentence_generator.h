@@ -0,0 +1,169 @@
+#pragma once
+#ifndef __SENTENCE_GENERATOR_H__
+#define __SENTENCE_GENERATOR_H__
+
+#include "framework.h"
+#include "lr_parser.h"
+
+#include <stddef.h>
+#include <stdint.h>
+#include <ostream>
+#include <random>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+namespace parse {
+
+	/* Shape of the sentences a sentence_generator produces */
+	struct sentence_options_t {
+		size_t target_tokens = 64;      // Tokens the sentence grows to along its outermost recursion
+		size_t max_depth = 12;          // Height limit of subtrees expanded at random, raised where a derivation needs more
+		double recursion_weight = 0.7;  // Weight of an alternative that recurses, relative to 1 for the others,
+		                                // raised to the depth of the choice so that deep subtrees close up
+	};
+
+	/* A generated sentence */
+	struct generated_sentence_t {
+		std::vector<symbol_t> tokens;  // Terminals of the sentence
+		std::string text;              // Source text the lexer turns back into the same terminals
+	};
+
+	/* Edits turning a valid sentence into a near miss */
+	enum class mutation_t {
+		DELETE_TOKEN,   // One token removed
+		INSERT_TOKEN,   // A random terminal inserted
+		REPLACE_TOKEN,  // One token replaced by a different terminal
+		SWAP_TOKENS     // Two adjacent different tokens swapped
+	};
+
+	/* A sentence one edit away from a valid one */
+	struct near_miss_t : generated_sentence_t {
+		mutation_t mutation = mutation_t::DELETE_TOKEN;
+		size_t position = 0;  // Index of the token edited
+	};
+
+	/*
+	 * Generates random sentences of a grammar for load and fuzz inputs
+	 *
+	 * Walks lalr_grammar::productions and spells each terminal so that the lexer reads it back:
+	 * identifiers and literals get random spellings, every other terminal is written as its
+	 * name. Productions using a terminal the lexer cannot produce are left out.
+	 *
+	 * A sentence grows along its outermost recursion (e.g. the statement list of a program)
+	 * until it has about target_tokens tokens; everything hanging off that spine is expanded
+	 * at random under max_depth, with recursive alternatives weighted down the deeper they
+	 * are chosen. Right-recursive and directly left-recursive spines are produced front to
+	 * back without piling up pending symbols, so the text of a sentence can be streamed to
+	 * disk at any size (indirect left recursion keeps one pending symbol per repetition).
+	 *
+	 * The output depends only on the grammar, the lexer, the seed and the options.
+	 * The grammar must outlive the generator; near misses are checked against its tables if
+	 * they are built.
+	 */
+	class sentence_generator {
+	private:
+		/* A symbol of a right-hand side: a non-terminal index, or -1 - terminal index */
+		using symbol_ref_t = int32_t;
+
+		struct rule_t {
+			size_t left;                       // Non-terminal derived
+			std::vector<symbol_ref_t> right;   // Right-hand side, empty for epsilon
+			size_t min_length = 0;             // Fewest tokens the rule derives
+			size_t height = 0;                 // Lowest derivation tree the rule starts
+			bool recursive = false;            // The left-hand side appears in derivations of the right-hand side
+			bool stalls = false;               // Directly recursive, expected to add no tokens besides the recursion
+		};
+
+		/* Where expanded tokens go */
+		struct sink_t {
+			std::vector<symbol_t>* tokens = nullptr;  // Terminals, if wanted
+			std::string* text = nullptr;              // Source text, if wanted
+			std::ostream* out = nullptr;              // Stream text is flushed to, if any
+			size_t column = 0;                        // Bytes on the current line
+		};
+
+		const lalr_grammar& grammar;
+		std::vector<symbol_t> non_terminals;
+		std::vector<symbol_t> terminals;
+		std::vector<rule_t> rules;
+		std::vector<std::vector<size_t>> rules_of;  // Usable rules of each non-terminal
+		std::vector<size_t> min_length;             // Fewest tokens each non-terminal derives
+		std::vector<size_t> min_height;             // Lowest derivation tree of each non-terminal
+		std::vector<double> expected_length;        // Average tokens of a random expansion
+		std::vector<std::vector<bool>> reaches;     // reaches[a][b]: b appears in some derivation of a
+		std::vector<bool> can_grow;                 // Derives a recursive non-terminal
+		std::vector<size_t> usable_terminals;       // Terminals that appear in usable rules
+		std::unordered_set<std::string> reserved;   // Words that do not lex as identifiers
+		size_t start = 0;
+		std::mt19937_64 rng;
+
+		/* Returns a random number below n */
+		size_t pick(size_t n) {
+			return static_cast<size_t>(rng() % n);
+		}
+
+		/* Returns a random number in [0, 1) */
+		double pick_unit() {
+			return static_cast<double>(rng() >> 11) * (1.0 / 9007199254740992.0);
+		}
+
+		/* Appends the spelling of a terminal to the text */
+		void spell(size_t terminal, std::string& text);
+
+		/* Writes a terminal to the sink */
+		void emit(size_t terminal, sink_t& sink);
+
+		/*
+		 * Expands a non-terminal into the sink and returns the number of tokens produced
+		 * If grow is set it grows along its recursion until target_tokens were produced.
+		 */
+		size_t expand(size_t symbol, bool grow, const sentence_options_t& options, sink_t& sink);
+
+		/* Returns true if the grammar's tables accept the terminals */
+		bool accepts(const std::vector<symbol_t>& tokens) const;
+
+		/* Applies a random mutation to a sentence */
+		void mutate(near_miss_t& sentence);
+
+		/* Rewrites the text of a sentence from its tokens */
+		void respell(generated_sentence_t& sentence);
+
+	public:
+		/* Throws std::runtime_error if the start symbol derives no sentence the lexer can produce */
+		sentence_generator(const lalr_grammar& grammar, const lexer& lex, uint64_t seed);
+
+		/* Restarts the random sequence */
+		void reseed(uint64_t seed) {
+			rng.seed(seed);
+		}
+
+		/*
+		 * Generates a valid sentence
+		 * A grammar whose conflicts are resolved by precedence derives sentences its tables
+		 * reject (e.g. a < b < c with < declared %nonassoc); if the tables are built, such
+		 * sentences are generated again, up to a limit.
+		 */
+		generated_sentence_t generate(const sentence_options_t& options = {});
+
+		/*
+		 * Generates a sentence and streams its text to out without keeping it in memory
+		 * Returns the number of tokens written. Unlike generate() this cannot check the
+		 * sentence against the tables.
+		 */
+		size_t generate(std::ostream& out, const sentence_options_t& options = {});
+
+		/*
+		 * Generates a sentence one edit away from a valid one
+		 * If the grammar's tables are built the edit is retried until they reject the result,
+		 * so an accidental valid sentence is only returned when no edit tried broke it.
+		 */
+		near_miss_t generate_near_miss(const sentence_options_t& options = {});
+	};
+
+	/* Returns the name of a mutation as used in reports */
+	const char* mutation_name(mutation_t mutation);
+
+}
+
+#endif
@@ -0,0 +1,147 @@
+#pragma once
+#ifndef __SIMD_SCAN_H__
+#define __SIMD_SCAN_H__
+
+#include <stdint.h>
+#include <stddef.h>
+
+#if defined(__AVX2__)
+#define __SIMD_SCAN_AVX2__						1
+#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define __SIMD_SCAN_SSE2__						1
+#include <emmintrin.h>
+#endif
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+/*
+ * Vectorized byte scanning used by the lexer
+ *
+ * The scanners process 32 (AVX2) or 16 (SSE2) bytes per step and fall back to a
+ * byte-at-a-time loop for the tail and on targets without SSE2. Counting uses popcount
+ * on the compare masks.
+ */
+namespace parse::simd {
+
+	/* Returns the number of set bits */
+	inline uint32_t popcount32(uint32_t x) {
+#if defined(_MSC_VER) && defined(__SIMD_SCAN_AVX2__)
+		return static_cast<uint32_t>(__popcnt(x));
+#elif defined(__GNUC__) || defined(__clang__)
+		return static_cast<uint32_t>(__builtin_popcount(x));
+#else
+		x = x - ((x >> 1) & 0x55555555u);
+		x = (x & 0x33333333u) + ((x >> 2) & 0x33333333u);
+		return (((x + (x >> 4)) & 0x0F0F0F0Fu) * 0x01010101u) >> 24;
+#endif
+	}
+
+	/* Returns the index of the lowest set bit; x must not be zero */
+	inline uint32_t lowest_bit(uint32_t x) {
+#if defined(_MSC_VER)
+		unsigned long index;
+		_BitScanForward(&index, x);
+		return static_cast<uint32_t>(index);
+#else
+		return static_cast<uint32_t>(__builtin_ctz(x));
+#endif
+	}
+
+	/* Same classification as std::isspace in the C locale */
+	inline bool is_blank(char c) {
+		return c == ' ' || static_cast<unsigned char>(c - '\t') <= '\r' - '\t';
+	}
+
+#if defined(__SIMD_SCAN_AVX2__)
+	constexpr size_t block_size = 32;
+
+	/* Bitmask of the bytes equal to c in the 32-byte block at p */
+	inline uint32_t match_mask(const char* p, char c) {
+		__m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+		return static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, _mm256_set1_epi8(c))));
+	}
+
+	/* Bitmask of the blank bytes in the 32-byte block at p */
+	inline uint32_t blank_mask(const char* p) {
+		__m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+		__m256i shifted = _mm256_sub_epi8(v, _mm256_set1_epi8('\t'));
+		__m256i control = _mm256_cmpeq_epi8(_mm256_min_epu8(shifted, _mm256_set1_epi8('\r' - '\t')), shifted);
+		__m256i space = _mm256_cmpeq_epi8(v, _mm256_set1_epi8(' '));
+		return static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_or_si256(control, space)));
+	}
+#elif defined(__SIMD_SCAN_SSE2__)
+	constexpr size_t block_size = 16;
+
+	/* Bitmask of the bytes equal to c in the 16-byte block at p */
+	inline uint32_t match_mask(const char* p, char c) {
+		__m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+		return static_cast<uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(v, _mm_set1_epi8(c))));
+	}
+
+	/* Bitmask of the blank bytes in the 16-byte block at p */
+	inline uint32_t blank_mask(const char* p) {
+		__m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+		__m128i shifted = _mm_sub_epi8(v, _mm_set1_epi8('\t'));
+		__m128i control = _mm_cmpeq_epi8(_mm_min_epu8(shifted, _mm_set1_epi8('\r' - '\t')), shifted);
+		__m128i space = _mm_cmpeq_epi8(v, _mm_set1_epi8(' '));
+		return static_cast<uint32_t>(_mm_movemask_epi8(_mm_or_si128(control, space)));
+	}
+#else
+	constexpr size_t block_size = 0;
+#endif
+
+	/* Returns the offset of the first non-blank byte in [pos, size), or size if there is none */
+	inline size_t skip_blanks(const char* data, size_t pos, size_t size) {
+#if defined(__SIMD_SCAN_AVX2__) || defined(__SIMD_SCAN_SSE2__)
+		constexpr uint32_t full = block_size == 32 ? 0xFFFFFFFFu : 0xFFFFu;
+
+		while (pos + block_size <= size) {
+			uint32_t blanks = blank_mask(data + pos);
+			if (blanks != full)
+				return pos + lowest_bit(~blanks & full);
+			pos += block_size;
+		}
+#endif
+		while (pos < size && is_blank(data[pos]))
+			pos++;
+		return pos;
+	}
+
+	/* Returns the offset of the first byte equal to c in [pos, size), or size if there is none */
+	inline size_t find_byte(const char* data, size_t pos, size_t size, char c) {
+#if defined(__SIMD_SCAN_AVX2__) || defined(__SIMD_SCAN_SSE2__)
+		while (pos + block_size <= size) {
+			uint32_t found = match_mask(data + pos, c);
+			if (found)
+				return pos + lowest_bit(found);
+			pos += block_size;
+		}
+#endif
+		while (pos < size && data[pos] != c)
+			pos++;
+		return pos;
+	}
+
+	/* Returns the number of bytes equal to c in [pos, size) */
+	inline size_t count_byte(const char* data, size_t pos, size_t size, char c) {
+		size_t count = 0;
+#if defined(__SIMD_SCAN_AVX2__) || defined(__SIMD_SCAN_SSE2__)
+		while (pos + block_size <= size) {
+			count += popcount32(match_mask(data + pos, c));
+			pos += block_size;
+		}
+#endif
+		while (pos < size) {
+			if (data[pos] == c)
+				count++;
+			pos++;
+		}
+		return count;
+	}
+
+}
+
+#endif
@@ -0,0 +1,143 @@
+#include "framework.h"
+#include "source_buffer.h"
+
+#include <cstring>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+
+#ifdef _WIN32
+
+parse::mapped_file_source::mapped_file_source(const std::string& filename)
+{
+	HANDLE file = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr,
+		OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+	if (file == INVALID_HANDLE_VALUE)
+		return;
+	file_handle = file;
+
+	LARGE_INTEGER file_size;
+	if (!GetFileSizeEx(file, &file_size))
+		return;
+
+	size = static_cast<size_t>(file_size.QuadPart);
+	if (size == 0) {
+		// Empty files cannot be mapped, expose an empty window instead
+		opened = true;
+		return;
+	}
+
+	HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	if (mapping == nullptr)
+		return;
+	mapping_handle = mapping;
+
+	data = static_cast<const char*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+	opened = data != nullptr;
+}
+
+parse::mapped_file_source::~mapped_file_source()
+{
+	if (data != nullptr)
+		UnmapViewOfFile(data);
+	if (mapping_handle != nullptr)
+		CloseHandle(mapping_handle);
+	if (file_handle != nullptr)
+		CloseHandle(file_handle);
+}
+
+#else
+
+parse::mapped_file_source::mapped_file_source(const std::string& filename)
+{
+	fd = ::open(filename.c_str(), O_RDONLY);
+	if (fd < 0)
+		return;
+
+	struct stat st;
+	if (::fstat(fd, &st) != 0)
+		return;
+
+	size = static_cast<size_t>(st.st_size);
+	if (size == 0) {
+		// Empty files cannot be mapped, expose an empty window instead
+		opened = true;
+		return;
+	}
+
+	void* mapped = ::mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+	if (mapped == MAP_FAILED)
+		return;
+
+	::madvise(mapped, size, MADV_SEQUENTIAL);
+	data = static_cast<const char*>(mapped);
+	opened = true;
+}
+
+parse::mapped_file_source::~mapped_file_source()
+{
+	if (data != nullptr)
+		::munmap(const_cast<char*>(data), size);
+	if (fd >= 0)
+		::close(fd);
+}
+
+#endif
+
+
+parse::chunked_file_source::chunked_file_source(const std::string& filename, size_t chunk_size)
+	: buffer(chunk_size > 0 ? chunk_size : default_chunk_size)
+{
+	file = std::fopen(filename.c_str(), "rb");
+	if (file != nullptr)
+		fill();
+}
+
+parse::chunked_file_source::~chunked_file_source()
+{
+	if (file != nullptr)
+		std::fclose(file);
+}
+
+void parse::chunked_file_source::fill()
+{
+	while (!eof && length < buffer.size()) {
+		size_t n = std::fread(buffer.data() + length, 1, buffer.size() - length, file);
+		length += n;
+		if (n == 0)
+			eof = true;
+	}
+}
+
+bool parse::chunked_file_source::refill(uint64_t keep_from)
+{
+	if (eof || file == nullptr)
+		return false;
+
+	// Move the kept tail to the front of the buffer
+	size_t discard = static_cast<size_t>(keep_from - offset);
+	if (discard > length)
+		discard = length;
+	if (discard > 0) {
+		std::memmove(buffer.data(), buffer.data() + discard, length - discard);
+		length -= discard;
+		offset += discard;
+	}
+
+	// A token larger than the whole buffer needs a bigger buffer to make progress
+	if (length == buffer.size())
+		buffer.resize(buffer.size() * 2);
+
+	fill();
+	return true;
+}
@@ -0,0 +1,142 @@
+#pragma once
+#ifndef __SOURCE_BUFFER_H__
+#define __SOURCE_BUFFER_H__
+
+#include "framework.h"
+
+#include <stdint.h>
+#include <cstdio>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace parse {
+
+	/*
+	 * Source of input bytes presented to the lexer as a sliding window
+	 *
+	 * The lexer reads directly from window() without copying. When it needs bytes beyond
+	 * the window it calls refill() with the first offset it still needs; everything before
+	 * that offset may be discarded, so views into the window stay valid only until then.
+	 * Offsets are absolute positions in the whole input.
+	 */
+	class source_buffer {
+	public:
+		virtual ~source_buffer() = default;
+
+		/* Returns the currently buffered bytes */
+		virtual std::string_view window() const = 0;
+
+		/* Returns the absolute offset of the first byte of window() */
+		virtual uint64_t window_offset() const = 0;
+
+		/* Returns true if window() extends to the end of the input */
+		virtual bool at_end() const = 0;
+
+		/*
+		 * Discards the bytes before keep_from (an absolute offset inside the window) and
+		 * buffers more input after the kept bytes
+		 * Returns false if the window could not change (the input is exhausted).
+		 */
+		virtual bool refill(uint64_t keep_from) = 0;
+	};
+
+	/*
+	 * Source backed by a read-only memory mapping of a whole file
+	 *
+	 * The window is the entire file, so refill() never has anything to do and the page
+	 * cache performs all I/O. An empty file yields an empty window.
+	 */
+	class mapped_file_source : public source_buffer {
+	private:
+		const char* data = nullptr;  // Start of the mapping
+		size_t size = 0;             // Size of the file in bytes
+		bool opened = false;         // Whether the file was opened and mapped
+#ifdef _WIN32
+		void* file_handle = nullptr;     // HANDLE of the file
+		void* mapping_handle = nullptr;  // HANDLE of the file mapping
+#else
+		int fd = -1;                     // Descriptor of the file
+#endif
+
+	public:
+		/* Maps the given file; check is_open() for success */
+		explicit mapped_file_source(const std::string& filename);
+		~mapped_file_source() override;
+
+		mapped_file_source(const mapped_file_source&) = delete;
+		mapped_file_source& operator=(const mapped_file_source&) = delete;
+
+		/* Returns true if the file was opened and mapped */
+		bool is_open() const {
+			return opened;
+		}
+
+		std::string_view window() const override {
+			return std::string_view(data, size);
+		}
+
+		uint64_t window_offset() const override {
+			return 0;
+		}
+
+		bool at_end() const override {
+			return true;
+		}
+
+		bool refill(uint64_t) override {
+			return false;
+		}
+	};
+
+	/*
+	 * Source reading a file through a fixed-size buffer
+	 *
+	 * refill() moves the kept tail of the window to the front of the buffer and reads
+	 * more of the file behind it, so memory stays bounded by the buffer size. A kept
+	 * tail that fills the whole buffer (a single huge token) grows the buffer.
+	 */
+	class chunked_file_source : public source_buffer {
+	private:
+		std::FILE* file = nullptr;   // File being read
+		std::vector<char> buffer;    // Buffer holding the window
+		size_t length = 0;           // Number of valid bytes in buffer
+		uint64_t offset = 0;         // Absolute offset of buffer[0]
+		bool eof = false;            // Whether the whole file has been read
+
+		/* Reads as much of the file as fits behind the valid bytes */
+		void fill();
+
+	public:
+		static constexpr size_t default_chunk_size = 1 << 20;
+
+		/* Opens the given file; check is_open() for success */
+		explicit chunked_file_source(const std::string& filename, size_t chunk_size = default_chunk_size);
+		~chunked_file_source() override;
+
+		chunked_file_source(const chunked_file_source&) = delete;
+		chunked_file_source& operator=(const chunked_file_source&) = delete;
+
+		/* Returns true if the file was opened */
+		bool is_open() const {
+			return file != nullptr;
+		}
+
+		std::string_view window() const override {
+			return std::string_view(buffer.data(), length);
+		}
+
+		uint64_t window_offset() const override {
+			return offset;
+		}
+
+		bool at_end() const override {
+			return eof;
+		}
+
+		bool refill(uint64_t keep_from) override;
+	};
+
+}
+
+#endif
@@ -0,0 +1,150 @@
+#pragma once
+#ifndef __STRING_POOL_H__
+#define __STRING_POOL_H__
+
+#include "framework.h"
+
+#include <stdint.h>
+#include <cstring>
+#include <algorithm>
+#include <memory>
+#include <string_view>
+#include <vector>
+
+namespace parse {
+
+	using atom_t = uint32_t;
+	constexpr atom_t INVALID_ATOM = 0xFFFFFFFFu;
+
+	/*
+	 * Pool of interned strings identified by dense 32-bit atoms
+	 *
+	 * Each distinct string is stored once in arena blocks and gets the next atom, so equal
+	 * strings always have equal atoms and can be compared in O(1). Lookup uses an open
+	 * addressing table with linear probing holding atoms; the hash of every atom is kept so
+	 * probes compare hashes before bytes and growing never rehashes the strings.
+	 * Views returned by str() stay valid until clear() or destruction.
+	 */
+	class string_pool {
+	private:
+		static constexpr size_t block_size = 64 * 1024;
+		static constexpr uint32_t empty_slot = 0xFFFFFFFFu;
+
+		std::vector<std::unique_ptr<char[]>> blocks;  // Arena blocks holding the string bytes
+		size_t block_capacity = 0;                    // Size of the last block
+		size_t block_used = 0;                        // Bytes used in the last block
+		std::vector<std::string_view> strings;        // String of each atom
+		std::vector<uint32_t> hashes;                 // Hash of each atom
+		std::vector<uint32_t> slots;                  // Open addressing table of atoms, empty_slot if free
+		uint32_t slot_mask = 0;                       // slots.size() - 1 (the size is a power of two)
+
+		/* Hashes a string 8 bytes at a time */
+		static uint32_t hash(std::string_view s) {
+			uint64_t h = 0x9E3779B97F4A7C15ull ^ s.size();
+			size_t i = 0;
+			for (; i + 8 <= s.size(); i += 8) {
+				uint64_t word;
+				std::memcpy(&word, s.data() + i, 8);
+				h = (h ^ word) * 0xFF51AFD7ED558CCDull;
+				h ^= h >> 32;
+			}
+			uint64_t tail = 0;
+			if (i < s.size())
+				std::memcpy(&tail, s.data() + i, s.size() - i);
+			h = (h ^ tail) * 0xC4CEB9FE1A85EC53ull;
+			h ^= h >> 29;
+			return static_cast<uint32_t>(h);
+		}
+
+		/* Copies a string into the arena */
+		std::string_view store(std::string_view s) {
+			if (blocks.empty() || s.size() > block_capacity - block_used) {
+				// Strings larger than a block get a block of their own
+				block_capacity = std::max(block_size, s.size());
+				blocks.emplace_back(new char[block_capacity]);
+				block_used = 0;
+			}
+			char* dest = blocks.back().get() + block_used;
+			if (!s.empty())
+				std::memcpy(dest, s.data(), s.size());
+			block_used += s.size();
+			return std::string_view(dest, s.size());
+		}
+
+		/* Doubles the table, keeping the load factor at most one half */
+		void grow() {
+			size_t capacity = slots.empty() ? 64 : slots.size() * 2;
+			slots.assign(capacity, empty_slot);
+			slot_mask = static_cast<uint32_t>(capacity - 1);
+
+			for (atom_t atom = 0; atom < strings.size(); atom++) {
+				uint32_t slot = hashes[atom] & slot_mask;
+				while (slots[slot] != empty_slot)
+					slot = (slot + 1) & slot_mask;
+				slots[slot] = atom;
+			}
+		}
+
+		/* Returns the slot holding s, or the free slot where it belongs */
+		uint32_t probe(std::string_view s, uint32_t h) const {
+			uint32_t slot = h & slot_mask;
+			while (slots[slot] != empty_slot) {
+				atom_t atom = slots[slot];
+				if (hashes[atom] == h && strings[atom] == s)
+					break;
+				slot = (slot + 1) & slot_mask;
+			}
+			return slot;
+		}
+
+	public:
+		/* Returns the atom of a string, adding it to the pool if it is not there yet */
+		atom_t intern(std::string_view s) {
+			if ((strings.size() + 1) * 2 > slots.size())
+				grow();
+
+			uint32_t h = hash(s);
+			uint32_t slot = probe(s, h);
+			if (slots[slot] != empty_slot)
+				return slots[slot];
+
+			atom_t atom = static_cast<atom_t>(strings.size());
+			strings.push_back(store(s));
+			hashes.push_back(h);
+			slots[slot] = atom;
+			return atom;
+		}
+
+		/* Returns the atom of a string, or INVALID_ATOM if it was never interned */
+		atom_t find(std::string_view s) const {
+			if (slots.empty())
+				return INVALID_ATOM;
+			uint32_t slot = probe(s, hash(s));
+			return slots[slot] != empty_slot ? slots[slot] : INVALID_ATOM;
+		}
+
+		/* Returns the string of an atom */
+		std::string_view str(atom_t atom) const {
+			return strings[atom];
+		}
+
+		/* Returns the number of distinct strings */
+		size_t size() const {
+			return strings.size();
+		}
+
+		/* Removes every string; previously returned atoms and views become invalid */
+		void clear() {
+			blocks.clear();
+			block_capacity = 0;
+			block_used = 0;
+			strings.clear();
+			hashes.clear();
+			slots.clear();
+			slot_mask = 0;
+		}
+	};
+
+}
+
+#endif
@@ -0,0 +1,446 @@
+#include "lr_parser.h"
+#include "compiler_frontend.h"
+#include "sentence_generator.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+/*
+ * Measures the runtime hot path on generated inputs: lexer::tokenize, lr_parser::parse and
+ * the end-to-end compiler_frontend::compile. For each grammar one large random sentence is
+ * timed for throughput (MB/s and tokens/s), and many small ones one by one for latency
+ * percentiles. The results are written as JSON, one record per grammar.
+ *
+ * Usage: runtime-bench [options]
+ *   --grammar FILE     Grammar to generate inputs for (repeatable).
+ *                      Default: ../lr-parser/examples/gram_exp02.txt and gram_exp04.txt
+ *   --tokens N         Target tokens of the large input. Default: 200000
+ *   --small N          Number of small inputs. Default: 1000
+ *   --small-tokens N   Target tokens of each small input. Default: 32
+ *   --repeat N         Runs over the large input; each stage reports its minimum and median. Default: 5
+ *   --seed N           Seed of the sentence generator. Default: 1
+ *   --output FILE      Write the JSON to FILE instead of stdout
+ *   --emit DIR         Also write the large input of each grammar to DIR/<grammar file name>
+ *   --counters N       Count the parses in parser_counters and report the N productions
+ *                      reduced most and states visited most on stderr; parse is then timed
+ *                      with the counters attached
+ *   --profile DIR      Build the tables with the states ordered by DIR/<grammar file name>.profile
+ *                      if it exists (see lalr_grammar::renumber_states), count the state visits
+ *                      of the run and add them to that file
+ *   --generate DIR     Only generate inputs: stream the large input of each grammar to
+ *                      DIR/<grammar file name> and write --small near misses (sentences one
+ *                      edit away from valid ones) of --small-tokens tokens to
+ *                      DIR/<grammar file name>.miss<N>.txt
+ */
+
+namespace {
+
+	using clock_type = std::chrono::steady_clock;
+
+	/* The stages timed, in order */
+	const char* const STAGES[] = { "tokenize", "tokenize_spans", "parse", "compile" };
+	constexpr size_t STAGE_COUNT = sizeof(STAGES) / sizeof(STAGES[0]);
+
+	/* Latency percentiles reported for the small inputs */
+	const double PERCENTILES[] = { 50, 90, 99, 100 };
+	constexpr size_t PERCENTILE_COUNT = sizeof(PERCENTILES) / sizeof(PERCENTILES[0]);
+
+	struct options_t {
+		std::vector<std::string> grammars;
+		size_t tokens = 200000;
+		size_t small = 1000;
+		size_t small_tokens = 32;
+		size_t repeat = 5;
+		uint64_t seed = 1;
+		std::string output;
+		std::string emit_dir;
+		std::string generate_dir;
+		size_t counters = 0;
+		std::string profile_dir;
+	};
+
+	/* Result of benchmarking one grammar */
+	struct result_t {
+		std::string grammar;
+		std::string status = "ok";               // "ok" or what went wrong
+		size_t bytes = 0;                        // Size of the large input
+		size_t tokens = 0;                       // Tokens of the large input
+		std::vector<double> stage_ms[STAGE_COUNT];   // Wall time of each stage on the large input, one entry per run
+		size_t small_bytes = 0;                  // Total size of the small inputs
+		size_t small_tokens = 0;                 // Total tokens of the small inputs
+		std::vector<double> small_us[STAGE_COUNT];   // Wall time of each stage on each small input
+	};
+
+	/* Silences std::cout and std::cerr while alive; building and compiling print a lot */
+	struct output_silencer {
+		std::streambuf* out = std::cout.rdbuf(nullptr);
+		std::streambuf* err = std::cerr.rdbuf(nullptr);
+
+		~output_silencer() {
+			std::cout.rdbuf(out);
+			std::cerr.rdbuf(err);
+		}
+	};
+
+	/* The objects timed, all for one grammar */
+	struct subject_t {
+		std::unique_ptr<parse::lr_parser> parser;
+		parse::lexer lex;
+		std::unique_ptr<compiler_frontend> frontend;
+
+		explicit subject_t(const std::string& grammar_file, std::shared_ptr<const parse::state_profile_t> profile = nullptr) {
+			output_silencer silencer;
+			auto grammar = grammar_parser(grammar_file);
+			grammar->normalize();
+			grammar->profile = std::move(profile);
+			parser = std::make_unique<parse::lr_parser>(std::move(grammar));
+			lex.use_grammar_keywords(*parser->grammar);
+			frontend = std::make_unique<compiler_frontend>(grammar_file);
+		}
+	};
+
+	double elapsed_ms(clock_type::time_point since)
+	{
+		return std::chrono::duration<double, std::milli>(clock_type::now() - since).count();
+	}
+
+	double median(std::vector<double> values)
+	{
+		if (values.empty())
+			return 0;
+		std::sort(values.begin(), values.end());
+		size_t mid = values.size() / 2;
+		return values.size() % 2 ? values[mid] : (values[mid - 1] + values[mid]) / 2;
+	}
+
+	double minimum(const std::vector<double>& values)
+	{
+		return values.empty() ? 0 : *std::min_element(values.begin(), values.end());
+	}
+
+	/* Nearest-rank percentile of sorted values */
+	double percentile(const std::vector<double>& sorted, double p)
+	{
+		if (sorted.empty())
+			return 0;
+		size_t rank = static_cast<size_t>(p / 100 * sorted.size() + 0.999999);
+		return sorted[std::min(sorted.size(), std::max<size_t>(rank, 1)) - 1];
+	}
+
+	std::string json_string(const std::string& s)
+	{
+		std::string result = "\"";
+		for (char c : s) {
+			switch (c) {
+			case '"': result += "\\\""; break;
+			case '\\': result += "\\\\"; break;
+			case '\n': result += "\\n"; break;
+			case '\t': result += "\\t"; break;
+			default:
+				if (static_cast<unsigned char>(c) < 0x20) {
+					char escaped[8];
+					std::snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+					result += escaped;
+				}
+				else {
+					result += c;
+				}
+			}
+		}
+		return result + "\"";
+	}
+
+	std::string json_number(double value)
+	{
+		char buffer[32];
+		std::snprintf(buffer, sizeof(buffer), "%.3f", value);
+		return buffer;
+	}
+
+	/*
+	 * Runs one stage on an input and returns its wall time in milliseconds
+	 * Throws std::runtime_error if the input is rejected; generated inputs are all valid.
+	 */
+	double run_stage(size_t stage, subject_t& subject, const std::string& text)
+	{
+		clock_type::time_point start;
+		double ms = 0;
+		bool ok = true;
+
+		switch (stage) {
+		case 0: {
+			start = clock_type::now();
+			auto tokens = subject.lex.tokenize(text);
+			ms = elapsed_ms(start);
+			ok = subject.lex.get_errors().empty();
+			break;
+		}
+		case 1: {
+			start = clock_type::now();
+			auto tokens = subject.lex.tokenize_spans(text);
+			ms = elapsed_ms(start);
+			ok = subject.lex.get_errors().empty();
+			break;
+		}
+		case 2: {
+			auto tokens = subject.lex.tokenize_spans(text);
+			start = clock_type::now();
+			ok = subject.parser->parse(tokens, subject.lex).success;
+			ms = elapsed_ms(start);
+			break;
+		}
+		case 3: {
+			output_silencer silencer;
+			start = clock_type::now();
+			ok = subject.frontend->compile(text);
+			ms = elapsed_ms(start);
+			break;
+		}
+		}
+
+		if (!ok)
+			throw std::runtime_error(std::string(STAGES[stage]) + " rejected a generated input");
+		return ms;
+	}
+
+	std::string file_name_of(const std::string& path)
+	{
+		size_t slash = path.find_last_of("/\\");
+		return slash == std::string::npos ? path : path.substr(slash + 1);
+	}
+
+	void run_grammar(const options_t& options, result_t& result)
+	{
+		std::string profile_file = options.profile_dir.empty() ? "" : options.profile_dir + "/" + file_name_of(result.grammar) + ".profile";
+		auto profile = std::make_shared<parse::state_profile_t>();
+		if (!profile_file.empty() && std::ifstream(profile_file))
+			*profile = parse::state_profile_t::load(profile_file);
+
+		subject_t subject(result.grammar, profile_file.empty() ? nullptr : profile);
+		parse::sentence_generator generator(*subject.parser->grammar, subject.lex, options.seed);
+
+		parse::sentence_options_t large_options;
+		large_options.target_tokens = options.tokens;
+		std::ostringstream large;
+		result.tokens = generator.generate(large, large_options);
+		std::string text = large.str();
+		result.bytes = text.size();
+
+		if (!options.emit_dir.empty()) {
+			std::ofstream file(options.emit_dir + "/" + file_name_of(result.grammar));
+			file << text;
+		}
+
+		std::shared_ptr<parse::parser_counters> counters;
+		if (options.counters > 0 || !profile_file.empty()) {
+			counters = std::make_shared<parse::parser_counters>(*subject.parser->grammar);
+			subject.parser->set_counters(counters);
+		}
+
+		for (size_t i = 0; i < options.repeat; i++) {
+			for (size_t stage = 0; stage < STAGE_COUNT; stage++)
+				result.stage_ms[stage].push_back(run_stage(stage, subject, text));
+		}
+
+		parse::sentence_options_t small_options;
+		small_options.target_tokens = options.small_tokens;
+		for (size_t i = 0; i < options.small; i++) {
+			parse::generated_sentence_t small = generator.generate(small_options);
+			result.small_bytes += small.text.size();
+			result.small_tokens += small.tokens.size();
+			for (size_t stage = 0; stage < STAGE_COUNT; stage++)
+				result.small_us[stage].push_back(run_stage(stage, subject, small.text) * 1000);
+		}
+
+		if (options.counters > 0)
+			std::cerr << "\n" << counters->collect().to_string(*subject.parser->grammar, options.counters);
+		if (!profile_file.empty()) {
+			profile->add_visits(*subject.parser->grammar, counters->collect().state_visits);
+			profile->save(profile_file);
+		}
+	}
+
+	/* Writes the inputs of a grammar to the --generate directory instead of timing them */
+	void generate_grammar(const options_t& options, result_t& result)
+	{
+		subject_t subject(result.grammar);
+		parse::sentence_generator generator(*subject.parser->grammar, subject.lex, options.seed);
+		std::string path = options.generate_dir + "/" + file_name_of(result.grammar);
+
+		parse::sentence_options_t large_options;
+		large_options.target_tokens = options.tokens;
+		std::ofstream large(path, std::ios::binary);
+		if (!large)
+			throw std::runtime_error("Failed to open " + path);
+		result.tokens = generator.generate(large, large_options);
+		result.bytes = static_cast<size_t>(large.tellp());
+
+		parse::sentence_options_t small_options;
+		small_options.target_tokens = options.small_tokens;
+		for (size_t i = 0; i < options.small; i++) {
+			parse::near_miss_t miss = generator.generate_near_miss(small_options);
+			std::ofstream file(path + ".miss" + std::to_string(i) + ".txt", std::ios::binary);
+			file << "// " << parse::mutation_name(miss.mutation) << " at token " << miss.position << "\n" << miss.text;
+		}
+	}
+
+	std::string to_json(const options_t& options, std::vector<result_t>& results)
+	{
+		std::ostringstream out;
+		out << "{\n  \"benchmark\": \"runtime\",\n  \"repeat\": " << options.repeat
+			<< ",\n  \"seed\": " << options.seed << ",\n  \"results\": [";
+
+		for (size_t r = 0; r < results.size(); r++) {
+			result_t& result = results[r];
+			out << (r == 0 ? "\n" : ",\n") << "    {"
+				<< "\"grammar\": " << json_string(result.grammar)
+				<< ", \"status\": " << json_string(result.status);
+
+			if (!result.stage_ms[0].empty()) {
+				out << ",\n     \"large\": {\"bytes\": " << result.bytes << ", \"tokens\": " << result.tokens;
+				for (size_t i = 0; i < STAGE_COUNT; i++) {
+					double ms = median(result.stage_ms[i]);
+					double seconds = std::max(ms, 1e-6) / 1000;
+					out << ", " << json_string(STAGES[i])
+						<< ": {\"min_ms\": " << json_number(minimum(result.stage_ms[i]))
+						<< ", \"median_ms\": " << json_number(ms)
+						<< ", \"mb_per_s\": " << json_number(result.bytes / seconds / 1e6)
+						<< ", \"tokens_per_s\": " << json_number(result.tokens / seconds) << "}";
+				}
+				out << "}";
+			}
+
+			if (!result.small_us[0].empty()) {
+				size_t count = result.small_us[0].size();
+				out << ",\n     \"small\": {\"count\": " << count
+					<< ", \"mean_bytes\": " << json_number(static_cast<double>(result.small_bytes) / count)
+					<< ", \"mean_tokens\": " << json_number(static_cast<double>(result.small_tokens) / count);
+				for (size_t i = 0; i < STAGE_COUNT; i++) {
+					std::sort(result.small_us[i].begin(), result.small_us[i].end());
+					out << ", " << json_string(STAGES[i]) << ": {";
+					for (size_t p = 0; p < PERCENTILE_COUNT; p++) {
+						out << (p == 0 ? "" : ", ") << "\"p" << PERCENTILES[p] << "_us\": "
+							<< json_number(percentile(result.small_us[i], PERCENTILES[p]));
+					}
+					out << "}";
+				}
+				out << "}";
+			}
+			out << "}";
+		}
+
+		out << "\n  ]\n}\n";
+		return out.str();
+	}
+
+	bool parse_options(int argc, char** argv, options_t& options)
+	{
+		for (int i = 1; i < argc; i++) {
+			std::string arg = argv[i];
+			if (i + 1 >= argc) {
+				std::cerr << "Missing value for " << arg << std::endl;
+				return false;
+			}
+			std::string value = argv[++i];
+
+			if (arg == "--grammar")
+				options.grammars.push_back(value);
+			else if (arg == "--tokens")
+				options.tokens = std::stoul(value);
+			else if (arg == "--small")
+				options.small = std::stoul(value);
+			else if (arg == "--small-tokens")
+				options.small_tokens = std::stoul(value);
+			else if (arg == "--repeat")
+				options.repeat = std::max<size_t>(1, std::stoul(value));
+			else if (arg == "--seed")
+				options.seed = std::stoull(value);
+			else if (arg == "--output")
+				options.output = value;
+			else if (arg == "--emit")
+				options.emit_dir = value;
+			else if (arg == "--generate")
+				options.generate_dir = value;
+			else if (arg == "--counters")
+				options.counters = std::stoul(value);
+			else if (arg == "--profile")
+				options.profile_dir = value;
+			else {
+				std::cerr << "Unknown option: " << arg << std::endl;
+				return false;
+			}
+		}
+
+		if (options.grammars.empty())
+			options.grammars = { "../lr-parser/examples/gram_exp02.txt", "../lr-parser/examples/gram_exp04.txt" };
+		return true;
+	}
+
+}
+
+int main(int argc, char** argv)
+{
+	options_t options;
+	try {
+		if (!parse_options(argc, argv, options))
+			return 2;
+	}
+	catch (const std::exception&) {
+		std::cerr << "Invalid number in the options" << std::endl;
+		return 2;
+	}
+
+	std::vector<result_t> results;
+
+	for (const std::string& grammar : options.grammars) {
+		result_t result;
+		result.grammar = grammar;
+
+		std::cerr << grammar << ": " << std::flush;
+		try {
+			if (!options.generate_dir.empty()) {
+				generate_grammar(options, result);
+				std::cerr << result.bytes << " bytes, " << result.tokens << " tokens, "
+					<< options.small << " near misses written" << std::endl;
+			}
+			else {
+				run_grammar(options, result);
+				double seconds = std::max(median(result.stage_ms[3]), 1e-6) / 1000;
+				std::cerr << result.bytes << " bytes, " << result.tokens << " tokens, compile "
+					<< json_number(result.bytes / seconds / 1e6) << " MB/s" << std::endl;
+			}
+		}
+		catch (const std::exception& e) {
+			result.status = e.what();
+			std::cerr << e.what() << std::endl;
+		}
+		results.push_back(std::move(result));
+	}
+
+	if (!options.generate_dir.empty()) {
+		bool ok = std::all_of(results.begin(), results.end(), [](const result_t& r) { return r.status == "ok"; });
+		return ok ? 0 : 1;
+	}
+
+	std::string json = to_json(options, results);
+	if (options.output.empty()) {
+		std::cout << json;
+	}
+	else {
+		std::ofstream file(options.output);
+		if (!file) {
+			std::cerr << "Failed to open " << options.output << std::endl;
+			return 1;
+		}
+		file << json;
+	}
+
+	return 0;
+}